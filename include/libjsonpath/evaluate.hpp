@@ -0,0 +1,614 @@
+#ifndef LIBJSONPATH_EVALUATE_H
+#define LIBJSONPATH_EVALUATE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "libjsonpath/exceptions.hpp"
+#include "libjsonpath/functions.hpp"
+#include "libjsonpath/path.hpp"
+#include "libjsonpath/selectors.hpp"
+
+namespace libjsonpath {
+
+// Query evaluation, shared by Python objects and FrozenDocuments.
+//
+// The visitors below are templated over a context class, which gives them a
+// uniform view of one kind of document. A context defines these types:
+//
+//   node_t     A node selected by a query.
+//   nodes_t    A list of nodes.
+//   value_t    The result of a filter expression that is not a node list.
+//   current_t  The value a filter is applied to.
+//   filter_t   Applies a filter selector to one value at a time.
+//
+// a `nothing` value_t and a `native_functions` map, and member functions
+// to navigate nodes (is_array, is_object, size, member, item and
+// next_child), to build and compare values (null, boolean, integer, real,
+// string, value, length, is_false, is_nothing, equal and less_than), to
+// resolve embedded queries (resolve, exists and root_query), and to call
+// regular expressions and function extensions.
+//
+// An output has push(node_t) and done() members, and a keeps_locations
+// constant. Child nodes only get a location if it is true.
+
+// The result of evaluating a filter expression. Node lists are either owned
+// by the result or borrowed from a memoized root query.
+template <typename Context>
+using expression_result_t =
+    std::variant<typename Context::nodes_t, const typename Context::nodes_t*,
+                 typename Context::value_t>;
+
+// Return the node list held by _rv_, or nullptr if _rv_ holds a value.
+template <typename Nodes, typename Value>
+const Nodes* node_list(const std::variant<Nodes, const Nodes*, Value>& rv) {
+  if (auto nodes{std::get_if<Nodes>(&rv)}) {
+    return nodes;
+  }
+  if (auto nodes{std::get_if<const Nodes*>(&rv)}) {
+    return *nodes;
+  }
+  return nullptr;
+}
+
+// Return the node list from an evaluated function argument declared as a
+// node list. The result is only valid for as long as _rv_ is.
+template <typename Nodes, typename Value>
+const Nodes& nodes_argument(
+    const std::variant<Nodes, const Nodes*, Value>& rv) {
+  static const Nodes empty{};
+  auto nodes{node_list(rv)};
+  return nodes ? *nodes : empty;
+}
+
+// JSONPath expression result truthiness test.
+template <typename Context>
+bool is_truthy(const Context& context,
+               const expression_result_t<Context>& rv) {
+  if (auto nodes{node_list(rv)}) {
+    return !nodes->empty();
+  }
+  return !context.is_false(std::get<typename Context::value_t>(rv));
+}
+
+// Return the value of an evaluated function argument declared as a value,
+// unpacking single node lists and converting other node lists to nothing.
+template <typename Context>
+typename Context::value_t value_of(const Context& context,
+                                   const expression_result_t<Context>& rv) {
+  if (auto nodes{node_list(rv)}) {
+    if (nodes->size() == 1) {
+      return context.value((*nodes)[0]);
+    }
+    return context.nothing;
+  }
+  return std::get<typename Context::value_t>(rv);
+}
+
+// Replace a single node list with the value of its node.
+template <typename Context>
+expression_result_t<Context> unpack(const Context& context,
+                                    expression_result_t<Context> rv) {
+  auto nodes{node_list(rv)};
+  if (nodes && nodes->size() == 1) {
+    return context.value((*nodes)[0]);
+  }
+  return rv;
+}
+
+template <typename Context>
+bool node_list_equals(const Context& context,
+                      const typename Context::nodes_t& left,
+                      const expression_result_t<Context>& right_) {
+  if (auto right{std::get_if<typename Context::value_t>(&right_)}) {
+    // left is an empty node list and right is nothing.
+    if (left.empty()) {
+      return context.is_nothing(*right);
+    }
+
+    // left is a single element node list, compare the node's value to right.
+    if (left.size() == 1) {
+      return context.equal(context.value(left[0]), *right);
+    }
+
+    return false;
+  }
+
+  // left and right are node lists.
+  const auto& right{*node_list(right_)};
+
+  // Are both lists are empty?
+  if (left.empty() && right.empty()) {
+    return true;
+  }
+
+  // Do both lists have a single node?
+  if (left.size() == 1 && right.size() == 1) {
+    return context.equal(context.value(left[0]), context.value(right[0]));
+  }
+
+  return false;
+}
+
+template <typename Context>
+bool equals(const Context& context, const expression_result_t<Context>& left,
+            const expression_result_t<Context>& right) {
+  if (auto left_{node_list(left)}) {
+    return node_list_equals(context, *left_, right);
+  }
+
+  if (auto right_{node_list(right)}) {
+    return node_list_equals(context, *right_, left);
+  }
+
+  return context.equal(std::get<typename Context::value_t>(left),
+                       std::get<typename Context::value_t>(right));
+}
+
+template <typename Context>
+bool less_than(const Context& context, const expression_result_t<Context>& left,
+               const expression_result_t<Context>& right) {
+  if (node_list(left) || node_list(right)) {
+    return false;
+  }
+
+  return context.less_than(std::get<typename Context::value_t>(left),
+                           std::get<typename Context::value_t>(right));
+}
+
+// Compare unpacked operands _left_ and _right_. Empty node lists are equal
+// to nothing.
+template <typename Context>
+bool compare(const Context& context, const expression_result_t<Context>& left,
+             BinaryOperator op, const expression_result_t<Context>& right) {
+  switch (op) {
+    case BinaryOperator::eq:
+      return equals(context, left, right);
+    case BinaryOperator::ne:
+      return !equals(context, left, right);
+    case BinaryOperator::lt:
+      return less_than(context, left, right);
+    case BinaryOperator::gt:
+      return less_than(context, right, left);
+    case BinaryOperator::ge:
+      return less_than(context, right, left) || equals(context, left, right);
+    case BinaryOperator::le:
+      return less_than(context, left, right) || equals(context, left, right);
+    default:
+      return false;
+  }
+}
+
+// Evaluates a filter expression from its syntax tree, with _current_ as the
+// current node.
+template <typename Context>
+class ExpressionVisitor {
+public:
+  using rv_t = expression_result_t<Context>;
+
+private:
+  const Context& m_context;
+  typename Context::current_t m_current;
+
+public:
+  ExpressionVisitor(const Context& context,
+                    typename Context::current_t current)
+      : m_context{context}, m_current{std::move(current)} {}
+
+  ~ExpressionVisitor() = default;
+
+  rv_t operator()(const NullLiteral&) const { return m_context.null(); }
+
+  rv_t operator()(const BooleanLiteral& expression) const {
+    return m_context.boolean(expression.value);
+  }
+
+  rv_t operator()(const IntegerLiteral& expression) const {
+    return m_context.integer(expression.value);
+  }
+
+  rv_t operator()(const FloatLiteral& expression) const {
+    return m_context.real(expression.value);
+  }
+
+  rv_t operator()(const StringLiteral& expression) const {
+    return m_context.string(expression.value);
+  }
+
+  rv_t operator()(const Box<LogicalNotExpression>& expression) const {
+    return m_context.boolean(!test(expression->right));
+  }
+
+  rv_t operator()(const Box<InfixExpression>& expression) const {
+    // Logical operators only evaluate their right operand if the left
+    // operand does not decide the result. Node lists are existence tests
+    // here, so they are not unpacked.
+    if (expression->op == BinaryOperator::logical_and) {
+      return m_context.boolean(test(expression->left) &&
+                               test(expression->right));
+    }
+
+    if (expression->op == BinaryOperator::logical_or) {
+      return m_context.boolean(test(expression->left) ||
+                               test(expression->right));
+    }
+
+    rv_t left{unpack(m_context, std::visit(*this, expression->left))};
+    rv_t right{unpack(m_context, std::visit(*this, expression->right))};
+    return m_context.boolean(compare(m_context, left, expression->op, right));
+  }
+
+  rv_t operator()(const Box<RelativeQuery>& expression) const {
+    return m_context.resolve(expression->query, m_current);
+  }
+
+  rv_t operator()(const Box<RootQuery>& expression) const {
+    return m_context.root_query(*expression);
+  }
+
+  rv_t operator()(const Box<FunctionCall>& expression) const {
+    auto native_it{
+        m_context.native_functions.find(std::string{expression->name})};
+    if (native_it != m_context.native_functions.end()) {
+      return call_native(native_it->second, *expression);
+    }
+    return m_context.call_extension(*expression, *this);
+  }
+
+  // Evaluate _expression_ as a filter condition. A relative query used as a
+  // condition is an existence test, so it stops at the first node it finds.
+  bool test(const expression_t& expression) const {
+    if (auto query{std::get_if<Box<RelativeQuery>>(&expression)}) {
+      return m_context.exists((*query)->query, m_current);
+    }
+    return is_truthy(m_context, std::visit(*this, expression));
+  }
+
+private:
+  // Call a built-in function extension. Argument counts and types have been
+  // checked by the parser.
+  rv_t call_native(NativeFunction function, const FunctionCall& call) const {
+    switch (function) {
+      case NativeFunction::count: {
+        rv_t arg{std::visit(*this, call.args[0])};
+        return m_context.integer(
+            static_cast<std::int64_t>(nodes_argument(arg).size()));
+      }
+      case NativeFunction::length:
+        return m_context.length(value_argument(call.args[0]));
+      case NativeFunction::value: {
+        rv_t arg{std::visit(*this, call.args[0])};
+        const auto& nodes{nodes_argument(arg)};
+        if (nodes.size() == 1) {
+          return m_context.value(nodes[0]);
+        }
+        return m_context.nothing;
+      }
+      case NativeFunction::match:
+      case NativeFunction::search: {
+        auto fullmatch{function == NativeFunction::match};
+        auto string{value_argument(call.args[0])};
+        if (auto regex{m_context.literal_regex(call)}) {
+          return m_context.boolean(
+              m_context.regex_test(string, *regex, fullmatch));
+        }
+        return m_context.boolean(m_context.pattern_test(
+            string, value_argument(call.args[1]), fullmatch));
+      }
+      default:
+        throw NameError("unknown built-in function '" +
+                            std::string(call.name) + "'",
+                        call.token);
+    }
+  }
+
+  // Evaluate a function argument declared as a value.
+  typename Context::value_t value_argument(const expression_t& arg) const {
+    return value_of(m_context, std::visit(*this, arg));
+  }
+};
+
+// Applies a filter selector by walking its syntax tree.
+template <typename Context>
+class ExpressionFilter {
+private:
+  const Context& m_context;
+  const FilterSelector& m_selector;
+
+public:
+  ExpressionFilter(const Context& context, const FilterSelector& selector)
+      : m_context{context}, m_selector{selector} {}
+
+  // Return true if _current_ passes the filter.
+  bool test(const typename Context::current_t& current) const {
+    ExpressionVisitor<Context> visitor{m_context, current};
+    return visitor.test(m_selector.expression);
+  }
+};
+
+template <typename Context, typename Output>
+class SelectorVisitor {
+private:
+  using node_t = typename Context::node_t;
+  static constexpr bool keep_locations{Output::keeps_locations};
+
+  const Context& m_context;
+  const node_t& m_node;
+  Output& m_out;
+
+public:
+  SelectorVisitor(const Context& context, const node_t& node, Output& out)
+      : m_context{context}, m_node{node}, m_out{out} {}
+
+  ~SelectorVisitor() = default;
+
+  void operator()(const NameSelector& selector) {
+    auto child{m_context.template member<keep_locations>(m_node, selector)};
+    if (child) {
+      m_out.push(std::move(*child));
+    }
+  }
+
+  void operator()(const IndexSelector& selector) {
+    if (!m_context.is_array(m_node)) {
+      return;
+    }
+
+    auto length{m_context.size(m_node)};
+    auto index{normalized_index(length, selector.index, selector.token)};
+    if (index < length) {
+      m_out.push(m_context.template item<keep_locations>(m_node, index));
+    }
+  }
+
+  void operator()(const WildSelector&) {
+    select_each([](const auto&) { return true; });
+  }
+
+  void operator()(const SliceSelector& selector) {
+    if (!m_context.is_array(m_node)) {
+      return;
+    }
+
+    auto bounds{slice_bounds(selector, m_context.size(m_node))};
+    for (std::size_t n{0}; n < bounds.count && !m_out.done(); n++) {
+      // The array could have been changed by a filter function.
+      auto index{bounds.index(n)};
+      if (index >= m_context.size(m_node)) {
+        return;
+      }
+      m_out.push(m_context.template item<keep_locations>(m_node, index));
+    }
+  }
+
+  void operator()(const Box<FilterSelector>& selector) {
+    typename Context::filter_t filter{m_context, *selector};
+    select_each([&](const auto& current) { return filter.test(current); });
+  }
+
+  // Apply the wildcard and filter selectors from _first_ to _last_ to the
+  // children of the current node, visiting each child once. Nodes are still
+  // output in selector order, so nodes selected by all but the first
+  // selector are held until every child has been visited.
+  template <typename It>
+  void select_children(It first, It last) {
+    if (!m_context.is_array(m_node) && !m_context.is_object(m_node)) {
+      return;
+    }
+
+    // Wildcard selectors don't have a filter.
+    std::vector<std::optional<typename Context::filter_t>> filters{};
+    filters.reserve(static_cast<std::size_t>(std::distance(first, last)));
+    for (auto it{first}; it != last; it++) {
+      if (auto selector{std::get_if<Box<FilterSelector>>(&*it)}) {
+        filters.emplace_back(std::in_place, m_context, **selector);
+      } else {
+        filters.emplace_back(std::nullopt);
+      }
+    }
+
+    std::vector<bool> selected(filters.size());
+    std::vector<std::vector<node_t>> held(filters.size() - 1);
+    std::size_t position{0};
+    while (!m_out.done()) {
+      auto child{m_context.template next_child<keep_locations>(
+          m_node, position, [&](const auto& current) {
+            auto any{false};
+            for (std::size_t i{0}; i < filters.size(); i++) {
+              selected[i] = !filters[i] || filters[i]->test(current);
+              any = any || selected[i];
+            }
+            return any;
+          })};
+      if (!child) {
+        break;
+      }
+
+      for (std::size_t i{1}; i < filters.size(); i++) {
+        if (selected[i]) {
+          held[i - 1].push_back(*child);
+        }
+      }
+      if (selected[0]) {
+        m_out.push(std::move(*child));
+      }
+    }
+
+    for (auto& nodes : held) {
+      for (auto& node : nodes) {
+        if (m_out.done()) {
+          return;
+        }
+        m_out.push(std::move(node));
+      }
+    }
+  }
+
+private:
+  // Push each child of the current node that passes _test_, in order.
+  template <typename Test>
+  void select_each(Test&& test) {
+    std::size_t position{0};
+    while (!m_out.done()) {
+      auto child{m_context.template next_child<keep_locations>(
+          m_node, position, test)};
+      if (!child) {
+        return;
+      }
+      m_out.push(std::move(*child));
+    }
+  }
+};
+
+// Call _visit_ with _node_ and then every node below it, in document order,
+// until _visit_ returns false. The data is walked with an explicit stack
+// rather than by recursion, so deeply nested data can't overflow the C++
+// stack. Child locations are only built if _keep_locations_ is true.
+template <bool keep_locations, typename Context, typename Visit>
+void walk_descendants(const Context& context,
+                      const typename Context::node_t& node, Visit&& visit) {
+  using node_t = typename Context::node_t;
+
+  // A container node and the position of its next child.
+  struct Frame {
+    node_t node;
+    std::size_t position;
+  };
+
+  auto is_container = [&context](const node_t& node_) {
+    return context.is_array(node_) || context.is_object(node_);
+  };
+
+  if (!visit(node) || !is_container(node)) {
+    return;
+  }
+
+  std::vector<Frame> stack{};
+  stack.push_back({node, 0});
+  while (!stack.empty()) {
+    auto& frame{stack.back()};
+    auto child{context.template next_child<keep_locations>(
+        frame.node, frame.position, [](const auto&) { return true; })};
+    if (!child) {
+      stack.pop_back();
+      continue;
+    }
+
+    if (!visit(*child)) {
+      return;
+    }
+    if (is_container(*child)) {
+      stack.push_back({std::move(*child), 0});
+    }
+  }
+}
+
+template <typename Context, typename Output>
+class SegmentVisitor {
+private:
+  using node_t = typename Context::node_t;
+
+  const Context& m_context;
+  const node_t& m_node;
+  Output& m_out;
+
+public:
+  SegmentVisitor(const Context& context, const node_t& node, Output& out)
+      : m_context{context}, m_node{node}, m_out{out} {}
+
+  ~SegmentVisitor() = default;
+
+  void operator()(const Segment& segment) { select(segment, m_node); }
+
+  void operator()(const RecursiveSegment& segment) {
+    descend(segment, m_node);
+  }
+
+private:
+  // Apply the selectors in _segment_ to _node_. Consecutive wildcard and
+  // filter selectors share one pass over the node's children.
+  template <typename S>
+  void select(const S& segment, const node_t& node) {
+    SelectorVisitor<Context, Output> visitor{m_context, node, m_out};
+    const auto& selectors{segment.selectors};
+    auto it{selectors.begin()};
+    while (it != selectors.end() && !m_out.done()) {
+      auto run{std::find_if_not(it, selectors.end(), [](const auto& s) {
+        return std::holds_alternative<WildSelector>(s) ||
+               std::holds_alternative<Box<FilterSelector>>(s);
+      })};
+      if (std::distance(it, run) > 1) {
+        visitor.select_children(it, run);
+        it = run;
+      } else {
+        std::visit(visitor, *it);
+        it++;
+      }
+    }
+  }
+
+  // Apply the selectors in _segment_ to _node_ and every node below it, in
+  // document order.
+  void descend(const RecursiveSegment& segment, const node_t& node) {
+    walk_descendants<Output::keeps_locations>(
+        m_context, node, [&](const node_t& descendant) {
+          select(segment, descendant);
+          return !m_out.done();
+        });
+  }
+};
+
+template <typename Context, typename Output>
+void resolve_node(const Context& context, segments_t::const_iterator segment,
+                  segments_t::const_iterator end,
+                  const typename Context::node_t& node, Output& out);
+
+// Nodes selected by one segment are passed straight to the next segment, so
+// a query is evaluated depth first and no intermediate node lists are built.
+// Selection stops as soon as the final output is done.
+template <typename Context, typename Output>
+struct ChainOutput {
+  static constexpr bool keeps_locations{Output::keeps_locations};
+  const Context& context;
+  segments_t::const_iterator segment;
+  segments_t::const_iterator end;
+  Output& out;
+
+  void push(typename Context::node_t node) {
+    resolve_node(context, segment, end, node, out);
+  }
+
+  bool done() const { return out.done(); }
+};
+
+// Apply segments from _segment_ up to _end_ to _node_, pushing selected
+// nodes to _out_.
+template <typename Context, typename Output>
+void resolve_node(const Context& context, segments_t::const_iterator segment,
+                  segments_t::const_iterator end,
+                  const typename Context::node_t& node, Output& out) {
+  if (out.done()) {
+    return;
+  }
+
+  if (segment == end) {
+    out.push(node);
+    return;
+  }
+
+  ChainOutput<Context, Output> chain{context, std::next(segment), end, out};
+  SegmentVisitor<Context, ChainOutput<Context, Output>> visitor{
+      context, node, chain};
+  std::visit(visitor, *segment);
+}
+
+}  // namespace libjsonpath
+
+#endif
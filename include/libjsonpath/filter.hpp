@@ -0,0 +1,109 @@
+#ifndef LIBJSONPATH_FILTER_H
+#define LIBJSONPATH_FILTER_H
+
+#include <pybind11/pybind11.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "libjsonpath/selectors.hpp"
+#include "libjsonpath/singular.hpp"
+
+namespace py = pybind11;
+
+namespace libjsonpath {
+
+// Filter expressions are compiled to a flat sequence of instructions for a
+// stack machine. Literals are converted to Python objects and function
+// extensions are looked up once, when the query is compiled, instead of
+// every time the filter is applied to a node.
+enum class Opcode : std::uint8_t {
+  // Push constants[operand].
+  constant,
+
+  // Push the nodes selected by relative_queries[operand] from the current
+  // node.
+  relative_query,
+
+  // Push True if relative_queries[operand] selects at least one node from
+  // the current node, or False otherwise.
+  relative_exists,
+
+  // Push the value selected by singular_queries[operand] from the current
+  // node, or NOTHING if it doesn't select a node. Used for comparison
+  // operands and function arguments that expect a value.
+  singular_value,
+
+  // Like relative_exists, for singular_queries[operand].
+  singular_exists,
+
+  // Push the nodes selected by root_queries[operand]. Root queries are
+  // resolved at most once per document.
+  root_query,
+
+  // Replace the top of the stack with its truthiness, as a bool.
+  test,
+
+  // Replace the bool at the top of the stack with its negation.
+  logical_not,
+
+  // Jump to instruction _operand_ if the bool at the top of the stack is
+  // False (or True), leaving it on the stack. Otherwise pop it.
+  jump_if_false,
+  jump_if_true,
+
+  // Pop two operands and push the result of comparing them with the
+  // BinaryOperator _operand_.
+  compare,
+
+  // Replace the argument at the top of the stack with the result of the
+  // built-in function of the same name.
+  count,
+  length,
+  value,
+
+  // Pop a pattern and a string and push the result of the built-in match or
+  // search function. The pattern is a compiled regular expression if
+  // _operand_ is not zero, or a value to be compiled otherwise.
+  match,
+  search,
+
+  // Pop the arguments to calls[operand] and push its result.
+  call,
+};
+
+struct Instruction {
+  Opcode op;
+  std::uint32_t operand;
+};
+
+// A function extension implemented in Python, resolved by name when its
+// filter was compiled.
+struct CompiledCall {
+  py::function function;
+  FunctionExtensionTypes signature;
+};
+
+struct FilterProgram {
+  std::vector<Instruction> code;
+  std::vector<py::object> constants;
+  std::vector<const segments_t*> relative_queries;
+  std::vector<SingularQuery> singular_queries;
+  std::vector<const RootQuery*> root_queries;
+  std::vector<CompiledCall> calls;
+
+  // The largest number of values on the stack at any one time.
+  std::size_t max_stack{0};
+};
+
+// Compiled filter expressions, keyed by the address of their filter
+// selector. Filters that can't be compiled, because they call an undefined
+// function, are missing and evaluated from the syntax tree instead.
+using filter_program_map =
+    std::unordered_map<const FilterSelector*, FilterProgram>;
+
+}  // namespace libjsonpath
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef LIBJSONPATH_FROZEN_H
+#define LIBJSONPATH_FROZEN_H
+
+#include <pybind11/pybind11.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "libjsonpath/node.hpp"
+
+namespace py = pybind11;
+
+namespace libjsonpath {
+
+enum class TapeKind : std::uint8_t {
+  null,
+  boolean,
+  integer,
+  number,
+  string,
+  array,
+  object,
+};
+
+constexpr std::uint32_t NO_PARENT = std::numeric_limits<std::uint32_t>::max();
+
+// One JSON value in a FrozenDocument. Nodes refer to each other, and to
+// strings, by index.
+struct TapeNode {
+  TapeKind kind;
+
+  // The index of this node's parent, or NO_PARENT for the root node.
+  std::uint32_t parent;
+
+  // The string index of this node's key if its parent is an object, or its
+  // position in its parent array.
+  std::uint32_t member;
+
+  // The number of items in an array or object, and the offset of the first
+  // of their node indices in the document's child table.
+  std::uint32_t size;
+  std::uint32_t children;
+
+  // The offset of an object's member node indices, sorted by key, in the
+  // document's member table.
+  std::uint32_t members;
+
+  union {
+    bool boolean;
+    std::int64_t integer;
+    double number;
+    std::uint32_t string;
+  };
+};
+
+// An immutable copy of a tree of dicts, lists, strings, numbers, booleans
+// and None, converted once into a contiguous array of nodes. Keys and string
+// values are interned. Queries over a FrozenDocument read the tape without
+// touching Python objects, and only build Python values for the nodes they
+// return.
+class FrozenDocument {
+private:
+  std::vector<TapeNode> m_nodes;
+  std::vector<std::uint32_t> m_children;
+
+  // For each object, the node indices of its members sorted by interned key,
+  // so members can be found by binary search.
+  std::vector<std::uint32_t> m_members;
+
+  // A deque, so string_views of its strings stay valid as it grows.
+  std::deque<std::string> m_strings;
+  std::unordered_map<std::string_view, std::uint32_t> m_string_ids;
+
+  FrozenDocument() = default;
+
+  // Append a node for _obj_ to the tape and return its index. The child
+  // table slots of a dict or list are reserved, but not filled.
+  std::uint32_t freeze(py::handle obj, std::uint32_t parent,
+                       std::uint32_t member);
+  std::uint32_t intern(std::string_view value);
+
+  // Add the members of the object at _index_ to the member table. Its child
+  // table slots must already be filled.
+  void index_members(std::uint32_t index);
+  void write_json(std::uint32_t index, std::string& out) const;
+
+  friend class JSONParser;
+
+public:
+  // Convert _obj_ to a FrozenDocument. Raises a TypeError if _obj_ contains
+  // anything other than dicts with string keys, lists, strings, ints that
+  // fit in 64 bits, floats, booleans and None.
+  explicit FrozenDocument(py::handle obj);
+
+  FrozenDocument(const FrozenDocument&) = delete;
+  FrozenDocument& operator=(const FrozenDocument&) = delete;
+  FrozenDocument(FrozenDocument&&) = default;
+  FrozenDocument& operator=(FrozenDocument&&) = default;
+
+  // Parse UTF-8 encoded JSON text straight into a FrozenDocument, without
+  // creating any Python objects. Raises a ValueError if _json_ is not valid
+  // JSON, or contains an integer that doesn't fit in 64 bits. Strings are
+  // stored as UTF-8, so unlike json.loads, a \u escape of a lone surrogate
+  // is a ValueError too.
+  static FrozenDocument from_json(std::string_view json);
+
+  // Like from_json, but read from a bytes-like object. The GIL is released
+  // while parsing.
+  static FrozenDocument from_buffer(py::buffer buf);
+
+  const TapeNode& node(std::uint32_t index) const { return m_nodes[index]; }
+
+  // Return the node index of the item at _position_ of the array or object
+  // at _index_.
+  std::uint32_t child(std::uint32_t index, std::uint32_t position) const {
+    return m_children[m_nodes[index].children + position];
+  }
+
+  std::string_view string(std::uint32_t id) const { return m_strings[id]; }
+
+  // Return the id of the interned string equal to _value_, if there is one.
+  std::optional<std::uint32_t> string_id(std::string_view value) const;
+
+  // Return the node index of the member _key_ of the object at _index_, if
+  // it has one.
+  std::optional<std::uint32_t> member(std::uint32_t index,
+                                      std::uint32_t key) const;
+
+  std::size_t size() const { return m_nodes.size(); }
+
+  // Return a new Python object equal to the value of the node at _index_.
+  py::object to_python(std::uint32_t index = 0) const;
+
+  // Return the value of the node at _index_ serialized as compact, UTF-8
+  // encoded JSON. Doesn't need the GIL.
+  std::string to_json(std::uint32_t index = 0) const;
+
+  // Return the location of the node at _index_, relative to _base_.
+  location_link_t location(std::uint32_t index,
+                           location_link_t base = {}) const;
+};
+
+}  // namespace libjsonpath
+
+#endif
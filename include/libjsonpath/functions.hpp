@@ -0,0 +1,41 @@
+#ifndef LIBJSONPATH_FUNCTIONS_H
+#define LIBJSONPATH_FUNCTIONS_H
+
+#include <pybind11/pybind11.h>
+
+#include <string>
+#include <unordered_map>
+
+#include "libjsonpath/node.hpp"
+
+namespace py = pybind11;
+
+namespace libjsonpath {
+
+// Standard function extensions with built-in C++ implementations.
+enum class NativeFunction {
+  count,
+  length,
+  value,
+  match,
+  search,
+};
+
+// Function extension names that should be dispatched to a built-in
+// implementation instead of a Python callable.
+using native_function_map = std::unordered_map<std::string, NativeFunction>;
+
+// The standard `count` function. Return the number of nodes in a node list.
+py::object count_(const JSONPathNodeList& nodes);
+
+// The standard `length` function. Return the length of a string, array or
+// object, or _nothing_ if _obj_ does not have a length.
+py::object length_(py::handle obj, py::handle nothing);
+
+// The standard `value` function. Return the value of the only node in a
+// node list, or _nothing_ if there isn't exactly one node.
+py::object value_(const JSONPathNodeList& nodes, py::handle nothing);
+
+}  // namespace libjsonpath
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef LIBJSONPATH_LRU_CACHE_H
+#define LIBJSONPATH_LRU_CACHE_H
+
+#include <cstddef>        // std::size_t
+#include <list>           // std::list
+#include <mutex>          // std::lock_guard std::mutex
+#include <optional>       // std::optional
+#include <string>         // std::string
+#include <string_view>    // std::string_view
+#include <unordered_map>  // std::unordered_map
+#include <utility>        // std::move
+
+namespace libjsonpath {
+
+// A snapshot of cache statistics.
+struct CacheInfo {
+  std::size_t hits;
+  std::size_t misses;
+  std::size_t evictions;
+  std::size_t size;
+  std::size_t capacity;
+};
+
+// A bounded, least recently used cache with string keys.
+//
+// Keys are stored alongside their values in a linked list and the index
+// holds views into those strings, so lookups by std::string_view never
+// allocate. A capacity of zero disables caching.
+//
+// A mutex guards the entries, index and statistics, so the cache itself can
+// be shared between threads that don't hold the GIL. It doesn't protect the
+// values: copying or dropping a cached Python object still needs the GIL.
+template <typename V>
+class LRUCache {
+private:
+  using entry_t = std::pair<std::string, V>;
+  using entries_t = std::list<entry_t>;
+
+  std::size_t m_capacity;
+  entries_t m_entries{};
+  std::unordered_map<std::string_view, typename entries_t::iterator> m_index{};
+  std::size_t m_hits{0};
+  std::size_t m_misses{0};
+  std::size_t m_evictions{0};
+  mutable std::mutex m_mutex{};
+
+public:
+  explicit LRUCache(std::size_t capacity) : m_capacity{capacity} {}
+
+  // Return the value for _key_ and mark it as most recently used, or an
+  // empty optional if _key_ is not cached.
+  std::optional<V> get(std::string_view key) {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    auto it{m_index.find(key)};
+    if (it == m_index.end()) {
+      m_misses++;
+      return std::nullopt;
+    }
+
+    m_hits++;
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return it->second->second;
+  }
+
+  // Add or replace the value for _key_, evicting the least recently used
+  // entry if the cache is full.
+  void put(std::string_view key, V value) {
+    if (m_capacity == 0) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    auto it{m_index.find(key)};
+    if (it != m_index.end()) {
+      it->second->second = std::move(value);
+      m_entries.splice(m_entries.begin(), m_entries, it->second);
+      return;
+    }
+
+    if (m_entries.size() >= m_capacity) {
+      m_index.erase(m_entries.back().first);
+      m_entries.pop_back();
+      m_evictions++;
+    }
+
+    m_entries.emplace_front(std::string{key}, std::move(value));
+    m_index.emplace(m_entries.front().first, m_entries.begin());
+  }
+
+  // Remove all entries and reset statistics.
+  void clear() {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_index.clear();
+    m_entries.clear();
+    m_hits = 0;
+    m_misses = 0;
+    m_evictions = 0;
+  }
+
+  CacheInfo info() const {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return {m_hits, m_misses, m_evictions, m_entries.size(), m_capacity};
+  }
+};
+
+}  // namespace libjsonpath
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef LIBJSONPATH_NAMES_H
+#define LIBJSONPATH_NAMES_H
+
+#include <pybind11/pybind11.h>
+
+#include <string_view>
+#include <unordered_map>
+
+#include "libjsonpath/selectors.hpp"
+
+namespace py = pybind11;
+
+namespace libjsonpath {
+
+// Python keys for name selectors, keyed by the address of the selector.
+using name_key_map = std::unordered_map<const NameSelector*, py::object>;
+
+// Return _name_ as an interned Python string with its hash already
+// computed, so looking it up in a dict doesn't decode or hash it again.
+py::object name_key(std::string_view name);
+
+// Make a key for every name selector in _segments_, including selectors in
+// queries embedded in filters.
+name_key_map compile_name_keys(const segments_t& segments);
+
+}  // namespace libjsonpath
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <pybind11/pybind11.h>
 
+#include <memory>
 #include <string>
 #include <variant>
 #include <vector>
@@ -13,20 +14,51 @@ namespace libjsonpath {
 
 using location_t = std::vector<std::variant<size_t, std::string>>;
 
+// One step in the location of a node, linked to the location of its parent.
+// Links are shared by all nodes below them, so extending a location is
+// constant time regardless of depth. Object keys are kept as Python objects
+// and only converted to strings when a location is materialised.
+struct LocationLink;
+using location_link_t = std::shared_ptr<const LocationLink>;
+
+struct LocationLink {
+  location_link_t parent;
+  std::variant<size_t, py::object> element;
+
+  LocationLink(location_link_t parent_,
+               std::variant<size_t, py::object> element_);
+
+  LocationLink(const LocationLink&) = delete;
+  LocationLink& operator=(const LocationLink&) = delete;
+
+  // Ancestors that aren't shared with another location are released one at
+  // a time, so dropping a very deep location can't overflow the stack.
+  ~LocationLink();
+};
+
+// Return the location of the child at _index_ of the node at _parent_.
+location_link_t extend_location(const location_link_t& parent, size_t index);
+
+// Return the location of the child at _key_ of the node at _parent_.
+location_link_t extend_location(const location_link_t& parent, py::object key);
+
 // A JSON-like object and its location within a JSON document.
 class JSONPathNode {
 public:
   py::object value;
-  location_t location;
+  location_link_t link;
+
+  JSONPathNode(py::object value_, location_link_t link_);
 
-  JSONPathNode(py::object& value_, location_t location_);
+  // Return the location of this node as a list of keys and indices.
+  location_t location() const;
 
   // Return the canonical string representation of the path to this node.
-  std::string path();
+  std::string path() const;
 };
 
 using JSONPathNodeList = std::vector<JSONPathNode>;
 
 }  // namespace libjsonpath
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,20 @@
+#ifndef LIBJSONPATH_NUMBERS_H
+#define LIBJSONPATH_NUMBERS_H
+
+#include <cstdint>
+#include <optional>
+
+namespace libjsonpath {
+
+// Return -1, 0 or 1 if _left_ is less than, equal to or greater than
+// _right_. An integer and a float are compared exactly, like Python compares
+// an int and a float, rather than by converting the integer to a double.
+// Returns nothing if either operand is NaN.
+int compare_numbers(std::int64_t left, std::int64_t right);
+std::optional<int> compare_numbers(std::int64_t left, double right);
+std::optional<int> compare_numbers(double left, std::int64_t right);
+std::optional<int> compare_numbers(double left, double right);
+
+}  // namespace libjsonpath
+
+#endif
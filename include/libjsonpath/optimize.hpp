@@ -0,0 +1,40 @@
+#ifndef LIBJSONPATH_OPTIMIZE_H
+#define LIBJSONPATH_OPTIMIZE_H
+
+#include <cstddef>
+
+#include "libjsonpath/selectors.hpp"
+
+namespace libjsonpath {
+
+// Relative, static costs of evaluating filter expressions.
+constexpr std::size_t LITERAL_COST = 0;
+constexpr std::size_t SINGULAR_QUERY_COST = 1;
+constexpr std::size_t QUERY_COST = 10;
+constexpr std::size_t DESCENDANT_QUERY_COST = 100;
+constexpr std::size_t FUNCTION_CALL_COST = 1000;
+
+// Return an estimate of the cost of evaluating _expression_ once.
+std::size_t expression_cost(const expression_t& expression);
+
+// Swap the operands of logical `&&` and `||` expressions so the cheaper
+// operand is evaluated first. This doesn't change which nodes are selected,
+// but function extensions written in Python can have side effects, and they
+// might be called in a different order, or not at all.
+void reorder_logical_operands(segments_t& segments);
+
+// Simplify filter expressions. Comparisons between literals are replaced by
+// their result, and operands of `&&`, `||` and `!` that can't change the
+// result of a filter are removed. Filters that are always true become
+// wildcard selectors and filters that are always false are removed. If that
+// leaves a segment with no selectors, the query can't select anything and
+// the segments that follow it are removed too. to_string renders that
+// segment as `[]`, which isn't valid JSONPath and can't be parsed again.
+//
+// Removed operands are never evaluated, so function extensions written in
+// Python might be called fewer times than the query suggests.
+void fold_constants(segments_t& segments);
+
+}  // namespace libjsonpath
+
+#endif
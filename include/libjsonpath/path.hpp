@@ -1,11 +1,25 @@
 #ifndef LIBJSONPATH_PATH_H
 #define LIBJSONPATH_PATH_H
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
 #include <string_view>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "libjsonpath/filter.hpp"
+#include "libjsonpath/frozen.hpp"
+#include "libjsonpath/functions.hpp"
+#include "libjsonpath/lru_cache.hpp"
+#include "libjsonpath/names.hpp"
 #include "libjsonpath/node.hpp"
 #include "libjsonpath/parse.hpp"
+#include "libjsonpath/regex.hpp"
+#include "libjsonpath/singular.hpp"
 #include "pybind11/pybind11.h"
 
 namespace py = pybind11;
@@ -18,35 +32,408 @@ using function_signature_map =
 
 using function_extension_map = std::unordered_map<std::string, py::function>;
 
+// Convert negative indicies to their positive equivalents given
+// an "array" length.
+size_t normalized_index(size_t length, std::int64_t index, const Token& token);
+
+// The indices of an array selected by a slice selector. The _n_th selected
+// index is _start_ + _n_ * _step_, for _n_ less than _count_.
+struct SliceBounds {
+  std::int64_t start;
+  std::int64_t step;
+  std::size_t count;
+
+  std::size_t index(std::size_t n) const {
+    return static_cast<std::size_t>(start +
+                                    static_cast<std::int64_t>(n) * step);
+  }
+};
+
+// Normalize the bounds of _selector_ for an array of _length_ items, the
+// same way Python normalizes slice bounds.
+SliceBounds slice_bounds(const SliceSelector& selector, std::size_t length);
+
 // Apply the JSONPath query represented by _segments_ to JSON-like data _obj_.
 JSONPathNodeList query_(const segments_t& segments, py::object obj,
-                        function_extension_map functions,
-                        function_signature_map signatures, py::object nothing);
+                        const function_extension_map& functions,
+                        const function_signature_map& signatures,
+                        py::object nothing);
 
 // Parse the JSONPath query expression _path_ and use it to query JSON-like
 // data in _obj_.
 JSONPathNodeList query_(std::string_view path, py::object obj,
-                        function_extension_map functions,
-                        function_signature_map signatures, py::object nothing);
+                        const function_extension_map& functions,
+                        const function_signature_map& signatures,
+                        py::object nothing);
+
+// Function extensions and the NOTHING sentinel used when evaluating queries.
+// Functions named in _native_functions_ are dispatched to their built-in
+// implementations rather than the Python callable in _functions_. Patterns
+// given to match and search that are not string literals are compiled
+// through _regex_cache_.
+// An EvaluationContext is built once per Env_ and never modified, so it can
+// be shared by every query compiled by that Env_.
+struct EvaluationContext {
+  const function_extension_map functions;
+  const function_signature_map signatures;
+  const py::object nothing;
+  const native_function_map native_functions;
+  const std::shared_ptr<RegexCache> regex_cache;
+};
+
+// Options controlling how an Env_ compiles query strings.
+struct CompileOptions {
+  // Evaluate the cheaper operand of logical `&&` and `||` expressions first.
+  bool reorder_logical_operands{false};
+
+  // Simplify filter expressions, folding comparisons between literals and
+  // removing filters that are always true or always false.
+  bool fold_constants{false};
+};
+
+// Apply compile time transformations selected by _options_ to _segments_.
+segments_t compile_segments(segments_t segments,
+                            const CompileOptions& options);
+
+// Parse _path_ with _parser_ and compile the result, with the GIL released.
+// Tokens in the returned segments are views into _path_.
+segments_t parse_segments(const Parser& parser, std::string_view path,
+                          const CompileOptions& options);
+
+// Compile every filter expression in _segments_, including filters in
+// queries embedded in other filters, to a FilterProgram. _regexes_ are the
+// precompiled string literal patterns for the same segments.
+filter_program_map compile_filters(const segments_t& segments,
+                                   const regex_map& regexes,
+                                   const EvaluationContext& context);
+
+// A parsed JSONPath query along with the query string its tokens refer to,
+// its precompiled string literal regular expressions, its compiled filters,
+// its name selector keys and, if it is a singular query, its chain of
+// lookups. Instances are shared, never moved, so those references stay
+// valid. Segments are parsed from the copy of the query string held here,
+// never from the caller's string, which might not outlive the cache entry.
+struct ParsedQuery {
+  ParsedQuery(std::string_view path_, const Parser& parser,
+              const CompileOptions& options, const EvaluationContext& context)
+      : path{path_},
+        segments{parse_segments(parser, path, options)},
+        regexes{compile_literal_regexes(segments, context.native_functions)},
+        programs{compile_filters(segments, regexes, context)},
+        singular{compile_singular_query(segments)},
+        names{compile_name_keys(segments)} {}
+
+  const std::string path;
+  const segments_t segments;
+  const regex_map regexes;
+  const filter_program_map programs;
+  const std::optional<SingularQuery> singular;
+  const name_key_map names;
+};
+
+// A lazily evaluated JSONPath query. Nodes are selected one at a time, as
+// they are requested, so memory use is bounded by the depth and width of the
+// data rather than by the number of nodes matched.
+class NodeIterator {
+public:
+  NodeIterator(std::shared_ptr<const EvaluationContext> context,
+               std::shared_ptr<const ParsedQuery> query, py::object obj);
+  NodeIterator(NodeIterator&& other) noexcept;
+  ~NodeIterator();
+
+  // Return the next matching node, or nothing if there are no more nodes.
+  std::optional<JSONPathNode> next();
+
+private:
+  struct State;
+  std::unique_ptr<State> m_state;
+};
+
+// Nodes matched by a query over a FrozenDocument. Matches are found without
+// holding the GIL when the iterator is created, but Python values and node
+// locations are only built as nodes are requested. _doc_ must outlive the
+// iterator.
+class FrozenNodeIterator {
+public:
+  FrozenNodeIterator(const FrozenDocument& doc,
+                     std::vector<std::uint32_t> nodes);
+
+  // Iterate over nodes from _fallback_ instead, for queries that call a
+  // function extension implemented in Python.
+  explicit FrozenNodeIterator(NodeIterator fallback);
+
+  // Return the next matching node, or nothing if there are no more nodes.
+  std::optional<JSONPathNode> next();
+
+private:
+  const FrozenDocument* m_doc{nullptr};
+  std::vector<std::uint32_t> m_nodes{};
+  std::size_t m_position{0};
+  std::optional<NodeIterator> m_fallback{};
+};
+
+// Apply the segments of _query_ from _first_ on to the root node of _doc_,
+// without holding the GIL. Returns nothing if the query calls a function
+// extension implemented in Python.
+std::optional<std::vector<std::uint32_t>> resolve_frozen(
+    const FrozenDocument& doc, const EvaluationContext& context,
+    const ParsedQuery& query, segments_t::const_iterator first,
+    std::size_t limit);
+
+// Like resolve_frozen, but for use by threads that don't hold the GIL.
+std::optional<std::vector<std::uint32_t>> resolve_frozen_unlocked(
+    const FrozenDocument& doc, const EvaluationContext& context,
+    const ParsedQuery& query, segments_t::const_iterator first,
+    std::size_t limit);
+
+// Return true if the root node of _doc_ passes the test of _selector_, one of
+// the filter selectors of _query_. Returns nothing if the filter calls a
+// function extension implemented in Python.
+std::optional<bool> test_frozen(const FrozenDocument& doc,
+                                const EvaluationContext& context,
+                                const ParsedQuery& query,
+                                const FilterSelector& selector);
+
+constexpr std::size_t DEFAULT_CHUNK_SIZE = 65536;
+
+// A JSONPath query applied to JSON read incrementally from a binary file.
+// Parts of the document that can't contain a match are skipped without
+// being kept in memory. Values that must be seen whole are copied to a
+// FrozenDocument and queried from there. Those are values that match the
+// query, items tested by a filter selector, and values that the rest of the
+// query can't be applied to one item at a time.
+//
+// Nodes are returned in document order. That isn't always the order query
+// returns them in. A descendant segment applied by query selects from a
+// node's children before selecting from its deeper descendants, so `$..[1]`
+// on `[[7, 8], 9]` gives 9 then 8, where a stream gives 8 then 9.
+//
+// Members of an object are visited as they are read, so every member with a
+// duplicate key is selected, where json.loads would keep only the last one.
+// Values copied to a FrozenDocument keep only the last one too.
+class StreamIterator {
+public:
+  StreamIterator(std::shared_ptr<const EvaluationContext> context,
+                 std::shared_ptr<const ParsedQuery> query, py::object file,
+                 std::size_t chunk_size = DEFAULT_CHUNK_SIZE);
+  StreamIterator(StreamIterator&& other) noexcept;
+  ~StreamIterator();
+
+  // Return the next matching node, or nothing if there are no more nodes.
+  std::optional<JSONPathNode> next();
+
+private:
+  struct State;
+  std::unique_ptr<State> m_state;
+};
+
+constexpr std::size_t DEFAULT_NDJSON_CHUNK_SIZE = 1 << 20;
+
+// A JSONPath query applied to each line of newline delimited JSON by a pool
+// of threads. Lines are parsed and queried without holding the GIL, in
+// chunks of about _chunk_size_ bytes. Python objects are only created for
+// matched values, or for their JSON serialization if _as_json_ is true.
+//
+// The data is borrowed from a buffer, typically a memory-mapped file. Lines
+// are numbered from zero, and blank lines are skipped.
+class NDJSONIterator {
+public:
+  NDJSONIterator(std::shared_ptr<const EvaluationContext> context,
+                 std::shared_ptr<const ParsedQuery> query, py::buffer data,
+                 std::size_t threads, std::size_t chunk_size, bool ordered,
+                 bool as_json);
+  NDJSONIterator(NDJSONIterator&& other) noexcept;
+  ~NDJSONIterator();
+
+  // Return the number of the next line with at least one match, and its
+  // matched values, or nothing if there are no more lines. Lines are
+  // returned in order if _ordered_ was true, or as soon as they are ready
+  // otherwise.
+  std::optional<std::pair<std::size_t, py::list>> next();
+
+private:
+  struct State;
+  std::unique_ptr<State> m_state;
+};
+
+// A compiled JSONPath query bound to the evaluation context of the Env_
+// that compiled it.
+class Path_ {
+private:
+  std::shared_ptr<const EvaluationContext> m_context;
+  std::shared_ptr<const ParsedQuery> m_query;
+
+public:
+  Path_(std::shared_ptr<const EvaluationContext> context,
+        std::shared_ptr<const ParsedQuery> query)
+      : m_context{std::move(context)}, m_query{std::move(query)} {}
+
+  // Return nodes matched by this query, stopping after _limit_ nodes if a
+  // limit is given.
+  JSONPathNodeList query(py::object obj,
+                         std::optional<std::size_t> limit = std::nullopt) const;
+
+  // Return a list of values matched by this query, without node locations.
+  py::list findall(py::object obj) const;
+
+  // Like query and findall, but read a FrozenDocument without holding the
+  // GIL. Queries that call a function extension implemented in Python are
+  // applied to a Python copy of the document instead.
+  JSONPathNodeList query(const FrozenDocument& doc,
+                         std::optional<std::size_t> limit = std::nullopt) const;
+  py::list findall(const FrozenDocument& doc) const;
+  bool exists(const FrozenDocument& doc) const;
+  std::optional<JSONPathNode> first(const FrozenDocument& doc) const;
+  std::size_t count(const FrozenDocument& doc) const;
+  FrozenNodeIterator iter(const FrozenDocument& doc) const;
+
+  // Like query and findall, but parse UTF-8 encoded JSON from a bytes-like
+  // object. Python objects are only created for matched values.
+  JSONPathNodeList query_bytes(
+      py::buffer buf, std::optional<std::size_t> limit = std::nullopt) const;
+  py::list findall_bytes(py::buffer buf) const;
+
+  // Apply this query to each document in _docs_ and return a node list for
+  // each one. Evaluation state is reused from one document to the next.
+  // Documents that are FrozenDocuments are queried like query does.
+  std::vector<JSONPathNodeList> query_many(py::iterable docs) const;
+
+  // Like query_many, but return a list of values for each document.
+  py::list findall_many(py::iterable docs) const;
+
+  // Return true if this query matches at least one node.
+  bool exists(py::object obj) const;
+
+  // Return the first node matched by this query, if any.
+  std::optional<JSONPathNode> first(py::object obj) const;
+
+  // Return the number of nodes matched by this query.
+  std::size_t count(py::object obj) const;
+
+  // Return an iterator over nodes matched by this query.
+  NodeIterator iter(py::object obj) const;
+
+  // Return an iterator over nodes matched by this query in JSON read from
+  // _file_, a binary file-like object, _chunk_size_ bytes at a time.
+  StreamIterator stream(py::object file,
+                        std::size_t chunk_size = DEFAULT_CHUNK_SIZE) const;
+
+  // Return an iterator over matches in each line of newline delimited JSON
+  // in _data_, evaluated by _threads_ threads, or one per CPU if _threads_
+  // is zero.
+  NDJSONIterator query_ndjson(
+      py::buffer data, std::size_t threads = 0,
+      std::size_t chunk_size = DEFAULT_NDJSON_CHUNK_SIZE, bool ordered = true,
+      bool as_json = false) const;
+
+  const segments_t& segments() const { return m_query->segments; }
+  const std::string& path() const { return m_query->path; }
+};
+
+// A trie of query segments. Queries that start with the same segments share
+// a path from the root of the trie, and are listed by index at the node
+// where they end.
+struct SegmentTrie {
+  std::string key;
+  const segments_t::value_type* segment;
+  std::vector<std::size_t> queries;
+  std::vector<SegmentTrie> children;
+};
+
+// Compiled JSONPath queries that are evaluated together, in a single
+// traversal of the data. Segments shared by more than one query are only
+// evaluated once, and recursive descent segments starting from the same
+// nodes share one walk of their descendants.
+class QuerySet {
+private:
+  std::shared_ptr<const EvaluationContext> m_context;
+  std::vector<std::shared_ptr<const ParsedQuery>> m_queries;
+  SegmentTrie m_trie;
+  regex_map m_regexes;
+  filter_program_map m_programs;
+  name_key_map m_names;
+
+public:
+  QuerySet(std::shared_ptr<const EvaluationContext> context,
+           std::vector<std::shared_ptr<const ParsedQuery>> queries);
+
+  // Return a node list for each query, in the order queries were given.
+  std::vector<JSONPathNodeList> query(py::object obj) const;
+
+  // Return a list of values for each query, in the order queries were given.
+  py::list findall(py::object obj) const;
+
+  // Like query and findall, but read a FrozenDocument without holding the
+  // GIL. Each query is evaluated on its own, without sharing segments.
+  std::vector<JSONPathNodeList> query(const FrozenDocument& doc) const;
+  py::list findall(const FrozenDocument& doc) const;
+
+  std::size_t size() const { return m_queries.size(); }
+};
+
+constexpr std::size_t DEFAULT_CACHE_SIZE = 1024;
 
 class Env_ {
 private:
-  function_extension_map m_functions{};
-  function_signature_map m_signatures{};
-  py::object m_nothing{};
+  std::shared_ptr<const EvaluationContext> m_context;
   Parser m_parser{};
+  LRUCache<std::shared_ptr<const ParsedQuery>> m_cache;
+  CompileOptions m_options{};
+
+  // Return the parsed query for _path_, parsing it only if it is not cached.
+  std::shared_ptr<const ParsedQuery> parse_cached(std::string_view path);
 
 public:
   Env_(function_extension_map functions, function_signature_map signatures,
-       py::object nothing)
-      : m_functions{functions},
-        m_signatures{signatures},
-        m_nothing{nothing},
-        m_parser{signatures} {}
+       py::object nothing, native_function_map native_functions = {},
+       std::size_t cache_size = DEFAULT_CACHE_SIZE,
+       CompileOptions options = {},
+       std::size_t regex_cache_size = DEFAULT_REGEX_CACHE_SIZE)
+      : m_context{std::make_shared<const EvaluationContext>(EvaluationContext{
+            std::move(functions), signatures, nothing,
+            std::move(native_functions),
+            std::make_shared<RegexCache>(regex_cache_size)})},
+        m_parser{std::move(signatures)},
+        m_cache{cache_size},
+        m_options{options} {}
 
-  JSONPathNodeList query(std::string_view path, py::object obj);
+  JSONPathNodeList query(std::string_view path, py::object obj,
+                         std::optional<std::size_t> limit = std::nullopt);
+  py::list findall(std::string_view path, py::object obj);
+  JSONPathNodeList query(std::string_view path, const FrozenDocument& doc,
+                         std::optional<std::size_t> limit = std::nullopt);
+  py::list findall(std::string_view path, const FrozenDocument& doc);
+  bool exists(std::string_view path, const FrozenDocument& doc);
+  std::optional<JSONPathNode> first(std::string_view path,
+                                    const FrozenDocument& doc);
+  std::size_t count(std::string_view path, const FrozenDocument& doc);
+  FrozenNodeIterator iter(std::string_view path, const FrozenDocument& doc);
+  JSONPathNodeList query_bytes(std::string_view path, py::buffer buf,
+                               std::optional<std::size_t> limit = std::nullopt);
+  py::list findall_bytes(std::string_view path, py::buffer buf);
+  std::vector<JSONPathNodeList> query_many(std::string_view path,
+                                           py::iterable docs);
+  py::list findall_many(std::string_view path, py::iterable docs);
+  bool exists(std::string_view path, py::object obj);
+  std::optional<JSONPathNode> first(std::string_view path, py::object obj);
+  std::size_t count(std::string_view path, py::object obj);
+  NodeIterator iter(std::string_view path, py::object obj);
+  StreamIterator stream(std::string_view path, py::object file,
+                        std::size_t chunk_size = DEFAULT_CHUNK_SIZE);
+  NDJSONIterator query_ndjson(
+      std::string_view path, py::buffer data, std::size_t threads = 0,
+      std::size_t chunk_size = DEFAULT_NDJSON_CHUNK_SIZE, bool ordered = true,
+      bool as_json = false);
+  QuerySet query_set(const std::vector<std::string>& paths);
   JSONPathNodeList from_segments(const segments_t& segments, py::object obj);
   segments_t parse(std::string_view path);
+  Path_ compile(std::string_view path);
+
+  CacheInfo cache_info() const;
+  void cache_clear();
+
+  CacheInfo regex_cache_info() const;
+  void regex_cache_clear();
 };
 
 }  // namespace libjsonpath
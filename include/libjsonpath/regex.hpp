@@ -0,0 +1,63 @@
+#ifndef LIBJSONPATH_REGEX_H
+#define LIBJSONPATH_REGEX_H
+
+#include <pybind11/pybind11.h>
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "libjsonpath/functions.hpp"
+#include "libjsonpath/lru_cache.hpp"
+#include "libjsonpath/selectors.hpp"
+
+namespace py = pybind11;
+
+namespace libjsonpath {
+
+constexpr std::size_t DEFAULT_REGEX_CACHE_SIZE = 256;
+
+// Rewrite an I-Regexp (RFC 9485) pattern using Python `re` syntax.
+std::string iregexp_to_python(std::string_view pattern);
+
+// Compile an I-Regexp pattern to a Python `re.Pattern`, or return None if
+// the pattern is not valid.
+py::object compile_regex(std::string_view pattern);
+
+// Return true if the compiled pattern _regex_ matches all of _string_.
+// Non-string arguments and invalid (None) patterns never match.
+bool regex_fullmatch(py::handle regex, py::handle string);
+
+// Return true if the compiled pattern _regex_ matches part of _string_.
+// Non-string arguments and invalid (None) patterns never match.
+bool regex_search(py::handle regex, py::handle string);
+
+// A bounded cache of compiled regular expressions, keyed by I-Regexp
+// pattern. Invalid patterns are cached too, as None.
+class RegexCache {
+private:
+  LRUCache<py::object> m_cache;
+
+public:
+  explicit RegexCache(std::size_t capacity) : m_cache{capacity} {}
+
+  // Return the compiled pattern for _pattern_, compiling it if necessary.
+  py::object get(std::string_view pattern);
+
+  CacheInfo info() const { return m_cache.info(); }
+  void clear() { m_cache.clear(); }
+};
+
+// Compiled string literal patterns passed to match and search, keyed by the
+// address of the function call node.
+using regex_map = std::unordered_map<const FunctionCall*, py::object>;
+
+// Compile every string literal pattern passed to a function that is
+// dispatched to the built-in match or search function.
+regex_map compile_literal_regexes(const segments_t& segments,
+                                  const native_function_map& native_functions);
+
+}  // namespace libjsonpath
+
+#endif
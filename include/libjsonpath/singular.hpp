@@ -0,0 +1,46 @@
+#ifndef LIBJSONPATH_SINGULAR_H
+#define LIBJSONPATH_SINGULAR_H
+
+#include <pybind11/pybind11.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "libjsonpath/selectors.hpp"
+
+namespace py = pybind11;
+
+namespace libjsonpath {
+
+// A query made of name and index selectors only, one per segment, compiled
+// to a chain of lookups. It selects at most one node, without building a
+// node list for each segment.
+struct SingularQuery {
+  // Look up _name_ in an object, or _index_ in an array if _name_ is null.
+  // Names are interned Python strings with their hash computed in advance.
+  struct Step {
+    py::object name;
+    std::int64_t index;
+  };
+
+  std::vector<Step> steps;
+};
+
+// Return _segments_ compiled to a chain of lookups, or nothing if they are
+// not a singular query.
+std::optional<SingularQuery> compile_singular_query(const segments_t& segments);
+
+// Return the child of _obj_ selected by _step_, or a null object if there
+// isn't one. For index steps, _index_ is set to the normalized index.
+py::object lookup_step(const SingularQuery::Step& step, py::handle obj,
+                       std::size_t& index);
+
+// Return the value selected by _query_ from _obj_, or a null object if
+// nothing is selected.
+py::object lookup(const SingularQuery& query, py::handle obj);
+
+}  // namespace libjsonpath
+
+#endif
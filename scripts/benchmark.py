@@ -61,6 +61,10 @@ JUST_FIND_STMT = """\
 for path, data in compiled_queries:
     path.findall(data)"""
 
+JUST_FIND_VIA_NODES_STMT = """\
+for path, data in compiled_queries:
+    [node.value for node in path.query(data)]"""
+
 JUST_FIND_NODES_STMT = """\
 for path, data in compiled_queries:
     path.query(data)"""
@@ -109,6 +113,16 @@ def benchmark(number: int = 100, best_of: int = 3) -> None:
 
     print("just find".ljust(25), results)
 
+    results = timeit.repeat(
+        JUST_FIND_VIA_NODES_STMT,
+        setup=JUST_FIND_SETUP,
+        globals={"QUERIES": QUERIES},
+        number=number,
+        repeat=best_of,
+    )
+
+    print("just find (via nodes)".ljust(25), results)
+
     results = timeit.repeat(
         JUST_FIND_NODES_STMT,
         setup=JUST_FIND_SETUP,
@@ -0,0 +1,47 @@
+"""Per-element cost of existence tests over wide objects.
+
+Each pair of queries selects the same elements. The first query of each pair
+is an existence test, which stops at the first node it finds, the second
+forces the whole node list to be built.
+"""
+import timeit
+
+from libjsonpath import JSONPathEnvironment
+
+# ruff: noqa: D103 T201
+
+WIDTH = 1000
+
+DATA = [{f"k{j}": {"v": j} for j in range(WIDTH)} for _ in range(1000)]
+
+QUERIES = [
+    ("$[?@.*]", "$[?count(@.*) > 0]"),
+    ("$[?@.*.v]", "$[?count(@.*.v) > 0]"),
+    ("$[?@..v]", "$[?count(@..v) > 0]"),
+]
+
+
+def benchmark(number: int = 5, best_of: int = 3) -> None:
+    print(
+        f"filtering {len(DATA)} objects with {WIDTH} members "
+        f"{number} times, best of {best_of} rounds"
+    )
+
+    env = JSONPathEnvironment()
+    for pair in QUERIES:
+        for query in pair:
+            path = env.compile(query)
+            best = min(
+                timeit.repeat(
+                    "path.findall(data)",
+                    globals={"path": path, "data": DATA},
+                    number=number,
+                    repeat=best_of,
+                )
+            )
+            per_element = best / number / len(DATA) * 1e6
+            print(query.ljust(25), f"{per_element:.2f} us/element")
+
+
+if __name__ == "__main__":
+    benchmark()
@@ -0,0 +1,59 @@
+"""Per-element filter cost as the number of registered functions grows."""
+import timeit
+from typing import Tuple
+
+from libjsonpath import ExpressionType
+from libjsonpath import FilterFunction
+from libjsonpath import JSONPathEnvironment
+
+# ruff: noqa: D101 D102 D103 T201
+
+DATA = [{"a": i % 10, "b": [i, i + 1]} for i in range(100_000)]
+
+QUERIES = [
+    "$[?@.a == 1]",
+    "$[?@.b[?@ > 5]]",
+    "$[?count(@.b) == 2]",
+]
+
+
+class Noop(FilterFunction):
+    arg_types: Tuple[ExpressionType, ...] = (ExpressionType.value,)
+    return_type = ExpressionType.value
+
+    def __call__(self, obj: object) -> object:
+        return obj
+
+
+def environment(extra_functions: int) -> JSONPathEnvironment:
+    env = JSONPathEnvironment()
+    for i in range(extra_functions):
+        env.register_function(f"noop_{i}", Noop())
+    return env
+
+
+def benchmark(number: int = 5, best_of: int = 3) -> None:
+    print(f"filtering {len(DATA)} elements {number} times, best of {best_of} rounds")
+
+    for extra_functions in (0, 100, 1000):
+        env = environment(extra_functions)
+        for query in QUERIES:
+            path = env.compile(query)
+            best = min(
+                timeit.repeat(
+                    "path.query(data)",
+                    globals={"path": path, "data": DATA},
+                    number=number,
+                    repeat=best_of,
+                )
+            )
+            per_element = best / number / len(DATA) * 1e9
+            print(
+                f"{extra_functions:>5} functions".ljust(17),
+                query.ljust(25),
+                f"{per_element:.1f} ns/element",
+            )
+
+
+if __name__ == "__main__":
+    benchmark()
@@ -0,0 +1,58 @@
+"""Throughput of compiling and querying from several threads at once.
+
+Compiling queries and querying frozen documents don't hold the GIL, so
+throughput should scale with the number of threads, up to the number of
+cores.
+"""
+import time
+from concurrent.futures import ThreadPoolExecutor
+
+from libjsonpath import FrozenDocument
+from libjsonpath import JSONPathEnvironment
+
+# ruff: noqa: D103 T201
+
+THREADS = [1, 2, 4, 8]
+
+TASKS = 64
+
+DATA = FrozenDocument(
+    {"users": [{"name": f"user{i}", "score": i % 100} for i in range(10000)]}
+)
+
+QUERIES = [
+    "$.users[?@.score > 90 && @.name != 'user1'].name",
+    "$..[?@.score == 42].name",
+    "$.users[::3][?length(@.name) == 7].score",
+]
+
+
+class UncachedEnvironment(JSONPathEnvironment):
+    # Force each query to be lexed and parsed.
+    cache_size = 0
+
+
+def compile_queries(env: JSONPathEnvironment, n: int) -> None:
+    for i in range(200):
+        env.compile(f"$.users[?@.score > {n * 200 + i}].name")
+
+
+def run_queries(env: JSONPathEnvironment, _: int) -> None:
+    for query in QUERIES:
+        env.findall(query, DATA)
+
+
+def benchmark() -> None:
+    env = UncachedEnvironment()
+    for name, task in [("compile", compile_queries), ("query", run_queries)]:
+        print(name)
+        for threads in THREADS:
+            with ThreadPoolExecutor(max_workers=threads) as pool:
+                start = time.perf_counter()
+                list(pool.map(task, [env] * TASKS, range(TASKS)))
+                elapsed = time.perf_counter() - start
+            print(f"  {threads} threads".ljust(15), f"{TASKS / elapsed:.2f} tasks/s")
+
+
+if __name__ == "__main__":
+    benchmark()
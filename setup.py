@@ -17,9 +17,21 @@ ext_modules = [
     Pybind11Extension(
         name="_libjsonpath",
         sources=[
+            "src/libjsonpath/_filter.cpp",
+            "src/libjsonpath/_frozen.cpp",
+            "src/libjsonpath/_frozen_json.cpp",
+            "src/libjsonpath/_frozen_path.cpp",
+            "src/libjsonpath/_functions.cpp",
             "src/libjsonpath/_libjsonpath.cpp",
+            "src/libjsonpath/_names.cpp",
+            "src/libjsonpath/_ndjson.cpp",
             "src/libjsonpath/_node.cpp",
+            "src/libjsonpath/_numbers.cpp",
+            "src/libjsonpath/_optimize.cpp",
             "src/libjsonpath/_path.cpp",
+            "src/libjsonpath/_regex.cpp",
+            "src/libjsonpath/_singular.cpp",
+            "src/libjsonpath/_stream.cpp",
             *sorted(glob("extern/libjsonpath/src/libjsonpath/*.cpp")),
         ],
         include_dirs=[
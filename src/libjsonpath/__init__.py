@@ -1,8 +1,12 @@
 from _libjsonpath import BinaryOperator
 from _libjsonpath import BooleanLiteral
+from _libjsonpath import CacheInfo
+from _libjsonpath import CompileOptions
 from _libjsonpath import ExpressionType
 from _libjsonpath import FilterSelector
 from _libjsonpath import FloatLiteral
+from _libjsonpath import FrozenDocument
+from _libjsonpath import FrozenNodeIterator
 from _libjsonpath import FunctionCall
 from _libjsonpath import FunctionExtensionMap
 from _libjsonpath import FunctionExtensionTypes
@@ -18,16 +22,22 @@ from _libjsonpath import JSONPathTypeError
 from _libjsonpath import Lexer
 from _libjsonpath import LogicalNotExpression
 from _libjsonpath import NameSelector
+from _libjsonpath import NativeFunction
+from _libjsonpath import NDJSONIterator
+from _libjsonpath import NodeIterator
 from _libjsonpath import NullLiteral
 from _libjsonpath import parse
 from _libjsonpath import Parser
+from _libjsonpath import Path_
 from _libjsonpath import query_
+from _libjsonpath import QuerySet
 from _libjsonpath import RecursiveSegment
 from _libjsonpath import RelativeQuery
 from _libjsonpath import RootQuery
 from _libjsonpath import Segment
 from _libjsonpath import singular_query
 from _libjsonpath import SliceSelector
+from _libjsonpath import StreamIterator
 from _libjsonpath import StringLiteral
 from _libjsonpath import to_string
 from _libjsonpath import Token
@@ -46,13 +56,20 @@ from ._env import JSONPathEnvironment
 __all__ = (
     "BinaryOperator",
     "BooleanLiteral",
+    "CacheInfo",
+    "CompileOptions",
     "compile",
+    "count",
     "Env_",
+    "exists",
     "ExpressionType",
     "FilterFunction",
     "FilterSelector",
     "findall",
+    "first",
     "FloatLiteral",
+    "FrozenDocument",
+    "FrozenNodeIterator",
     "FunctionCall",
     "FunctionExtensionMap",
     "FunctionExtensionTypes",
@@ -70,17 +87,23 @@ __all__ = (
     "Lexer",
     "LogicalNotExpression",
     "NameSelector",
+    "NativeFunction",
+    "NDJSONIterator",
+    "NodeIterator",
     "NOTHING",
     "NullLiteral",
     "parse",
     "Parser",
+    "Path_",
     "query_",
+    "QuerySet",
     "RecursiveSegment",
     "RelativeQuery",
     "RootQuery",
     "Segment",
     "singular_query",
     "SliceSelector",
+    "StreamIterator",
     "StringLiteral",
     "to_string",
     "Token",
@@ -92,3 +115,6 @@ DEFAULT_ENV = JSONPathEnvironment()
 compile = DEFAULT_ENV.compile  # noqa: A001
 findall = DEFAULT_ENV.findall
 query = DEFAULT_ENV.query
+exists = DEFAULT_ENV.exists
+first = DEFAULT_ENV.first
+count = DEFAULT_ENV.count
@@ -1,9 +1,12 @@
 from enum import Enum
+from typing import BinaryIO
 from typing import Dict
+from typing import Iterable
 from typing import List
 from typing import Mapping
 from typing import Optional
 from typing import Sequence
+from typing import Tuple
 from typing import Union
 from typing import overload
 
@@ -14,6 +17,8 @@ from .filter_function import FilterFunction
 __all__ = (
     "BinaryOperator",
     "BooleanLiteral",
+    "CacheInfo",
+    "CompileOptions",
     "compile",
     "ExpressionType",
     "FilterFunction",
@@ -37,10 +42,12 @@ __all__ = (
     "Lexer",
     "LogicalNotExpression",
     "NameSelector",
+    "NativeFunction",
     "NOTHING",
     "NullLiteral",
     "parse",
     "Parser",
+    "Path_",
     "query_",
     "RecursiveSegment",
     "RelativeQuery",
@@ -315,19 +322,150 @@ def query_(
     nothing: object,
 ) -> List[JSONPathNode]: ...
 
+class NodeIterator:
+    def __iter__(self) -> NodeIterator: ...
+    def __next__(self) -> JSONPathNode: ...
+
+class FrozenNodeIterator:
+    def __iter__(self) -> FrozenNodeIterator: ...
+    def __next__(self) -> JSONPathNode: ...
+
+class StreamIterator:
+    def __iter__(self) -> StreamIterator: ...
+    def __next__(self) -> JSONPathNode: ...
+
+class NDJSONIterator:
+    def __iter__(self) -> NDJSONIterator: ...
+    def __next__(self) -> Tuple[int, List[object]]: ...
+
+class FrozenDocument:
+    def __init__(self, data: object) -> None: ...
+    @staticmethod
+    def from_json(data: bytes) -> FrozenDocument: ...
+    def to_python(self) -> object: ...
+    def __len__(self) -> int: ...
+
+class QuerySet:
+    def query(self, data: object) -> List[List[JSONPathNode]]: ...
+    def findall(self, data: object) -> List[List[object]]: ...
+    def __len__(self) -> int: ...
+
+class Path_:  # noqa: N801
+    def query(
+        self, data: object, limit: Optional[int] = None
+    ) -> List[JSONPathNode]: ...
+    def query_bytes(
+        self, data: bytes, limit: Optional[int] = None
+    ) -> List[JSONPathNode]: ...
+    def findall_bytes(self, data: bytes) -> List[object]: ...
+    def query_many(self, docs: Iterable[object]) -> List[List[JSONPathNode]]: ...
+    def findall_many(self, docs: Iterable[object]) -> List[List[object]]: ...
+    def exists(self, data: object) -> bool: ...
+    def first(self, data: object) -> Optional[JSONPathNode]: ...
+    def count(self, data: object) -> int: ...
+    @overload
+    def iter(self, data: FrozenDocument) -> FrozenNodeIterator: ...  # noqa: A003
+    @overload
+    def iter(self, data: object) -> NodeIterator: ...  # noqa: A003
+    def stream(self, file: BinaryIO, chunk_size: int = 65536) -> StreamIterator: ...
+    def query_ndjson(
+        self,
+        data: bytes,
+        threads: int = 0,
+        chunk_size: int = 1048576,
+        ordered: bool = True,
+        as_json: bool = False,
+    ) -> NDJSONIterator: ...
+    def findall(self, data: object) -> List[object]: ...
+    @property
+    def segments(self) -> Segments: ...
+    @property
+    def path(self) -> str: ...
+
+class CacheInfo:
+    @property
+    def hits(self) -> int: ...
+    @property
+    def misses(self) -> int: ...
+    @property
+    def evictions(self) -> int: ...
+    @property
+    def size(self) -> int: ...
+    @property
+    def capacity(self) -> int: ...
+
+class CompileOptions:
+    reorder_logical_operands: bool
+    fold_constants: bool
+    def __init__(self) -> None: ...
+
+class NativeFunction(Enum):
+    count = ...
+    length = ...
+    value = ...
+    match = ...
+    search = ...
+
 class Env_:  # noqa: N801
     def __init__(
         self,
         functions: FunctionExtensionMap,
         signatures: FunctionSignatureMap,
         nothing: object,
+        native_functions: Dict[str, NativeFunction] = ...,
+        cache_size: int = ...,
+        options: CompileOptions = ...,
+        regex_cache_size: int = ...,
     ) -> None: ...
-    def query(self, path: str, data: object) -> List[JSONPathNode]: ...
+    def query(
+        self, path: str, data: object, limit: Optional[int] = None
+    ) -> List[JSONPathNode]: ...
+    def query_bytes(
+        self, path: str, data: bytes, limit: Optional[int] = None
+    ) -> List[JSONPathNode]: ...
+    def findall_bytes(self, path: str, data: bytes) -> List[object]: ...
+    def query_many(
+        self, path: str, docs: Iterable[object]
+    ) -> List[List[JSONPathNode]]: ...
+    def findall_many(self, path: str, docs: Iterable[object]) -> List[List[object]]: ...
+    def exists(self, path: str, data: object) -> bool: ...
+    def first(self, path: str, data: object) -> Optional[JSONPathNode]: ...
+    def count(self, path: str, data: object) -> int: ...
+    @overload
+    def iter(  # noqa: A003
+        self, path: str, data: FrozenDocument
+    ) -> FrozenNodeIterator: ...
+    @overload
+    def iter(self, path: str, data: object) -> NodeIterator: ...  # noqa: A003
+    def stream(
+        self, path: str, file: BinaryIO, chunk_size: int = 65536
+    ) -> StreamIterator: ...
+    def query_ndjson(
+        self,
+        path: str,
+        data: bytes,
+        threads: int = 0,
+        chunk_size: int = 1048576,
+        ordered: bool = True,
+        as_json: bool = False,
+    ) -> NDJSONIterator: ...
+    def query_set(self, paths: List[str]) -> QuerySet: ...
+    def findall(self, path: str, data: object) -> List[object]: ...
     def from_segments(self, segments: Segments, data: object) -> List[JSONPathNode]: ...
     def parse(self, path: str) -> Segments: ...
+    def compile(self, path: str) -> Path_: ...  # noqa: A003
+    def cache_info(self) -> CacheInfo: ...
+    def cache_clear(self) -> None: ...
+    def regex_cache_info(self) -> CacheInfo: ...
+    def regex_cache_clear(self) -> None: ...
 
 def compile(path: str) -> JSONPath: ...
 def findall(path: str, data: object) -> List[object]: ...
-def query(path: str, data: object) -> List[JSONPathNode]: ...
+def query(
+    path: str, data: object, limit: Optional[int] = None
+) -> List[JSONPathNode]: ...
+def exists(path: str, data: object) -> bool: ...
+def first(path: str, data: object) -> Optional[JSONPathNode]: ...
+def count(path: str, data: object) -> int: ...
 
 NOTHING = object()
@@ -1,18 +1,30 @@
 from __future__ import annotations
 
+from os import PathLike
 from typing import TYPE_CHECKING
+from typing import BinaryIO
+from typing import Dict
+from typing import Iterable
+from typing import Iterator
 from typing import List
+from typing import Optional
+from typing import Tuple
+from typing import Union
 
 if TYPE_CHECKING:
+    from libjsonpath import CacheInfo
     from libjsonpath import FilterFunction
     from libjsonpath import JSONPathNode
+    from libjsonpath import QuerySet
     from libjsonpath import Segments
 
 
+from libjsonpath import CompileOptions
 from libjsonpath import Env_
 from libjsonpath import FunctionExtensionMap
 from libjsonpath import FunctionExtensionTypes
 from libjsonpath import FunctionSignatureMap
+from libjsonpath import NativeFunction
 
 from ._nothing import NOTHING
 from ._path import JSONPath
@@ -22,30 +34,79 @@ from .functions import Match
 from .functions import Search
 from .functions import Value
 
+# Function extension classes with built-in C++ implementations.
+STANDARD_FUNCTIONS = {
+    Count: NativeFunction.count,
+    Length: NativeFunction.length,
+    Match: NativeFunction.match,
+    Search: NativeFunction.search,
+    Value: NativeFunction.value,
+}
+
 
 class JSONPathEnvironment:
     __slots__ = ("_function_register", "_function_signatures", "_env")
 
+    cache_size: int = 1024
+    """The maximum number of parsed query strings to cache. Zero disables the
+    cache."""
+
+    regex_cache_size: int = 256
+    """The maximum number of compiled regular expressions to cache, for match
+    and search patterns that are not string literals. Zero disables the
+    cache."""
+
+    reorder_logical_operands: bool = False
+    """If True, reorder the operands of `&&` and `||` in filter expressions so
+    that the operand that is cheapest to evaluate is evaluated first."""
+
+    fold_constants: bool = False
+    """If True, simplify filter expressions when compiling queries. Comparisons
+    between literals are replaced by their result, and filters that are always
+    true or always false are replaced by a wildcard or removed.
+
+    Operands that are removed are never evaluated, so function extensions might
+    be called fewer times. A segment left with no selectors can't select
+    anything, and `to_string` renders it as `[]`, which is not valid JSONPath.
+    """
+
     def __init__(self) -> None:
         self._function_register = FunctionExtensionMap()
         self._function_signatures = FunctionSignatureMap()
         self.setup_function_register()
-        self._env = Env_(
+        self._env = self._new_env()
+
+    def _new_env(self) -> Env_:
+        options = CompileOptions()
+        options.reorder_logical_operands = self.reorder_logical_operands
+        options.fold_constants = self.fold_constants
+        return Env_(
             self._function_register,
             self._function_signatures,
             NOTHING,
+            native_functions=self._native_functions(),
+            cache_size=self.cache_size,
+            options=options,
+            regex_cache_size=self.regex_cache_size,
         )
 
+    def _native_functions(self) -> Dict[str, NativeFunction]:
+        # Only instances of the stock function classes are dispatched to their
+        # built-in implementations. Subclasses might override __call__.
+        return {
+            name: STANDARD_FUNCTIONS[type(func)]
+            for name, func in self._function_register.items()
+            if type(func) in STANDARD_FUNCTIONS
+        }
+
     def register_function(self, name: str, func: FilterFunction) -> None:
         self._function_register[name] = func
         self._function_signatures[name] = FunctionExtensionTypes(
             list(func.arg_types), func.return_type
         )
-        self._env = Env_(
-            self._function_register,
-            self._function_signatures,
-            NOTHING,
-        )
+        # A new Env_ starts with an empty query cache, so queries parsed with
+        # the old function signatures are never reused.
+        self._env = self._new_env()
 
     def setup_function_register(self) -> None:
         """Initialize function extensions."""
@@ -56,13 +117,116 @@ class JSONPathEnvironment:
         self.register_function("value", Value())
 
     def compile(self, path: str) -> JSONPath:  # noqa: A003
-        return JSONPath(self, self._env.parse(path))
+        return JSONPath(self, self._env.compile(path))
 
     def findall(self, path: str, data: object) -> List[object]:
-        return [node.value for node in self.query(path, data)]
+        return self._env.findall(path, data)
+
+    def query(
+        self, path: str, data: object, limit: Optional[int] = None
+    ) -> List[JSONPathNode]:
+        return self._env.query(path, data, limit)
+
+    def query_bytes(
+        self, path: str, data: bytes, limit: Optional[int] = None
+    ) -> List[JSONPathNode]:
+        """Return nodes matched by _path_ in UTF-8 encoded JSON _data_.
+
+        _data_ can be any bytes-like object. It is parsed without creating
+        Python objects for values that don't match.
+        """
+        return self._env.query_bytes(path, data, limit)
+
+    def findall_bytes(self, path: str, data: bytes) -> List[object]:
+        """Return values matched by _path_ in UTF-8 encoded JSON _data_."""
+        return self._env.findall_bytes(path, data)
 
-    def query(self, path: str, data: object) -> List[JSONPathNode]:
-        return self._env.query(path, data)
+    def query_many(
+        self, path: str, docs: Iterable[object]
+    ) -> List[List[JSONPathNode]]:
+        """Apply _path_ to each document in _docs_ and return a node list for
+        each one."""
+        return self._env.query_many(path, docs)
+
+    def findall_many(self, path: str, docs: Iterable[object]) -> List[List[object]]:
+        """Apply _path_ to each document in _docs_ and return a list of values
+        for each one."""
+        return self._env.findall_many(path, docs)
+
+    def exists(self, path: str, data: object) -> bool:
+        """Return True if _path_ matches at least one node in _data_."""
+        return self._env.exists(path, data)
+
+    def first(self, path: str, data: object) -> Optional[JSONPathNode]:
+        """Return the first node matched by _path_, or None."""
+        return self._env.first(path, data)
+
+    def count(self, path: str, data: object) -> int:
+        """Return the number of nodes matched by _path_."""
+        return self._env.count(path, data)
+
+    def iter(self, path: str, data: object) -> Iterator[JSONPathNode]:  # noqa: A003
+        """Return an iterator over nodes matched by _path_."""
+        return self._env.iter(path, data)
+
+    def stream(
+        self,
+        path: str,
+        source: Union[str, PathLike[str], BinaryIO],
+        chunk_size: int = 65536,
+    ) -> Iterator[JSONPathNode]:
+        """Return an iterator over nodes matched by _path_ in JSON read from
+        _source_, a file name or binary file-like object.
+
+        See JSONPath.stream.
+        """
+        return self.compile(path).stream(source, chunk_size)
+
+    def query_ndjson(
+        self,
+        path: str,
+        source: Union[str, PathLike[str], bytes],
+        *,
+        threads: Optional[int] = None,
+        chunk_size: int = 1 << 20,
+        ordered: bool = True,
+        as_json: bool = False,
+    ) -> Iterator[Tuple[int, List[object]]]:
+        """Apply _path_ to each line of newline delimited JSON in _source_,
+        a file name or bytes-like object, using a pool of threads.
+
+        See JSONPath.query_ndjson.
+        """
+        return self.compile(path).query_ndjson(
+            source,
+            threads=threads,
+            chunk_size=chunk_size,
+            ordered=ordered,
+            as_json=as_json,
+        )
+
+    def query_set(self, paths: Iterable[str]) -> QuerySet:
+        """Compile _paths_ into a QuerySet, which evaluates all of them in a
+        single traversal of the data. Segments shared by several queries are
+        only evaluated once."""
+        return self._env.query_set(list(paths))
 
     def from_segments(self, segments: Segments, data: object) -> List[JSONPathNode]:
         return self._env.from_segments(segments, data)
+
+    def cache_info(self) -> CacheInfo:
+        """Return hit, miss and eviction counts for the query cache."""
+        return self._env.cache_info()
+
+    def cache_clear(self) -> None:
+        """Remove all parsed queries from the query cache."""
+        self._env.cache_clear()
+
+    def regex_cache_info(self) -> CacheInfo:
+        """Return hit, miss and eviction counts for the regular expression
+        cache."""
+        return self._env.regex_cache_info()
+
+    def regex_cache_clear(self) -> None:
+        """Remove all compiled patterns from the regular expression cache."""
+        self._env.regex_cache_clear()
@@ -0,0 +1,273 @@
+#include <algorithm>  // std::max
+#include <cstddef>    // std::size_t
+#include <cstdint>    // std::uint32_t
+#include <optional>   // std::optional
+#include <string>     // std::string
+#include <utility>    // std::move
+#include <variant>    // std::visit std::holds_alternative
+
+#include "libjsonpath/filter.hpp"
+#include "libjsonpath/path.hpp"
+#include "libjsonpath/selectors.hpp"
+
+namespace py = pybind11;
+
+namespace libjsonpath {
+
+void collect_filters(const segments_t& segments, const regex_map& regexes,
+                     const EvaluationContext& context,
+                     filter_program_map& programs);
+
+// Compile a single filter expression. Filters in embedded queries are
+// compiled separately, into _programs_.
+class FilterCompiler {
+private:
+  const regex_map& m_regexes;
+  const EvaluationContext& m_context;
+  filter_program_map& m_programs;
+  FilterProgram m_program{};
+  std::size_t m_depth{0};
+  bool m_compiled{true};
+
+public:
+  FilterCompiler(const regex_map& regexes, const EvaluationContext& context,
+                 filter_program_map& programs)
+      : m_regexes{regexes}, m_context{context}, m_programs{programs} {}
+
+  // Return the compiled program for _selector_, or nothing if it calls a
+  // function that isn't defined.
+  std::optional<FilterProgram> compile(const FilterSelector& selector) {
+    test(selector.expression);
+    if (!m_compiled) {
+      return std::nullopt;
+    }
+    return std::move(m_program);
+  }
+
+  void operator()(const NullLiteral&) { constant(py::none()); }
+
+  void operator()(const BooleanLiteral& expression) {
+    constant(py::bool_(expression.value));
+  }
+
+  void operator()(const IntegerLiteral& expression) {
+    constant(py::int_(expression.value));
+  }
+
+  void operator()(const FloatLiteral& expression) {
+    constant(py::float_(expression.value));
+  }
+
+  void operator()(const StringLiteral& expression) {
+    constant(py::str(expression.value));
+  }
+
+  void operator()(const Box<LogicalNotExpression>& expression) {
+    test(expression->right);
+    emit(Opcode::logical_not);
+  }
+
+  void operator()(const Box<InfixExpression>& expression) {
+    // The right operand of a logical operator is skipped if the left operand
+    // decides the result.
+    if (expression->op == BinaryOperator::logical_and ||
+        expression->op == BinaryOperator::logical_or) {
+      test(expression->left);
+      auto jump{emit(expression->op == BinaryOperator::logical_and
+                         ? Opcode::jump_if_false
+                         : Opcode::jump_if_true)};
+      pop(1);
+      test(expression->right);
+      m_program.code[jump].operand =
+          static_cast<std::uint32_t>(m_program.code.size());
+      return;
+    }
+
+    value(expression->left);
+    value(expression->right);
+    emit(Opcode::compare, static_cast<std::uint32_t>(expression->op));
+    pop(1);
+  }
+
+  void operator()(const Box<RelativeQuery>& expression) {
+    emit(Opcode::relative_query, relative_query(expression->query));
+    push();
+  }
+
+  void operator()(const Box<RootQuery>& expression) {
+    collect_filters(expression->query, m_regexes, m_context, m_programs);
+    emit(Opcode::root_query, index(m_program.root_queries, &*expression));
+    push();
+  }
+
+  void operator()(const Box<FunctionCall>& expression) {
+    auto name{std::string{expression->name}};
+    auto native_it{m_context.native_functions.find(name)};
+    if (native_it != m_context.native_functions.end()) {
+      switch (native_it->second) {
+        case NativeFunction::count:
+          std::visit(*this, expression->args[0]);
+          emit(Opcode::count);
+          return;
+        case NativeFunction::length:
+          value(expression->args[0]);
+          emit(Opcode::length);
+          return;
+        case NativeFunction::value:
+          std::visit(*this, expression->args[0]);
+          emit(Opcode::value);
+          return;
+        case NativeFunction::match:
+          regex_call(Opcode::match, *expression);
+          return;
+        case NativeFunction::search:
+          regex_call(Opcode::search, *expression);
+          return;
+        default:
+          break;
+      }
+    }
+
+    auto it{m_context.functions.find(name)};
+    auto sig_it{m_context.signatures.find(name)};
+    if (it == m_context.functions.end() ||
+        sig_it == m_context.signatures.end()) {
+      // Leave it to the syntax tree evaluator to report the error, if this
+      // function is ever called. Filters in its arguments are still
+      // compiled.
+      m_compiled = false;
+      for (const auto& arg : expression->args) {
+        std::visit(*this, arg);
+      }
+      return;
+    }
+
+    const auto& types{sig_it->second.args};
+    for (std::size_t i{0}; i < expression->args.size(); i++) {
+      if (i < types.size() && types[i] != ExpressionType::nodes) {
+        value(expression->args[i]);
+      } else {
+        std::visit(*this, expression->args[i]);
+      }
+    }
+
+    emit(Opcode::call, index(m_program.calls,
+                             CompiledCall{it->second, sig_it->second}));
+    pop(expression->args.size());
+    push();
+  }
+
+private:
+  // Compile _expression_ so it leaves a bool on the stack. A relative query
+  // used as a condition is an existence test.
+  void test(const expression_t& expression) {
+    if (auto query{std::get_if<Box<RelativeQuery>>(&expression)}) {
+      if (auto singular{singular_query((*query)->query)}) {
+        emit(Opcode::singular_exists, *singular);
+      } else {
+        emit(Opcode::relative_exists, relative_query((*query)->query));
+      }
+      push();
+      return;
+    }
+
+    std::visit(*this, expression);
+    if (!std::holds_alternative<Box<InfixExpression>>(expression) &&
+        !std::holds_alternative<Box<LogicalNotExpression>>(expression)) {
+      emit(Opcode::test);
+    }
+  }
+
+  // Compile _expression_ where its value is used, rather than its node
+  // list. A singular query used this way is a chain of lookups.
+  void value(const expression_t& expression) {
+    if (auto query{std::get_if<Box<RelativeQuery>>(&expression)}) {
+      if (auto singular{singular_query((*query)->query)}) {
+        emit(Opcode::singular_value, *singular);
+        push();
+        return;
+      }
+    }
+    std::visit(*this, expression);
+  }
+
+  void regex_call(Opcode op, const FunctionCall& call) {
+    value(call.args[0]);
+    auto it{m_regexes.find(&call)};
+    if (it != m_regexes.end()) {
+      constant(it->second);
+      emit(op, 1);
+    } else {
+      value(call.args[1]);
+      emit(op, 0);
+    }
+    pop(1);
+  }
+
+  // Return the index of _query_ compiled to a chain of lookups, or nothing
+  // if it is not a singular query.
+  std::optional<std::uint32_t> singular_query(const segments_t& query) {
+    auto singular{compile_singular_query(query)};
+    if (!singular) {
+      return std::nullopt;
+    }
+    return index(m_program.singular_queries, std::move(*singular));
+  }
+
+  std::uint32_t relative_query(const segments_t& query) {
+    collect_filters(query, m_regexes, m_context, m_programs);
+    return index(m_program.relative_queries, &query);
+  }
+
+  void constant(py::object value) {
+    emit(Opcode::constant, index(m_program.constants, std::move(value)));
+    push();
+  }
+
+  std::size_t emit(Opcode op, std::uint32_t operand = 0) {
+    m_program.code.push_back({op, operand});
+    return m_program.code.size() - 1;
+  }
+
+  template <typename T>
+  std::uint32_t index(std::vector<T>& table, T item) {
+    table.push_back(std::move(item));
+    return static_cast<std::uint32_t>(table.size() - 1);
+  }
+
+  void push() {
+    m_depth++;
+    m_program.max_stack = std::max(m_program.max_stack, m_depth);
+  }
+
+  void pop(std::size_t n) { m_depth -= n; }
+};
+
+void collect_filters(const segments_t& segments, const regex_map& regexes,
+                     const EvaluationContext& context,
+                     filter_program_map& programs) {
+  for (const auto& segment : segments) {
+    std::visit(
+        [&](const auto& segment_) {
+          for (const auto& selector : segment_.selectors) {
+            if (auto filter{std::get_if<Box<FilterSelector>>(&selector)}) {
+              FilterCompiler compiler{regexes, context, programs};
+              if (auto program{compiler.compile(**filter)}) {
+                programs.emplace(&**filter, std::move(*program));
+              }
+            }
+          }
+        },
+        segment);
+  }
+}
+
+filter_program_map compile_filters(const segments_t& segments,
+                                   const regex_map& regexes,
+                                   const EvaluationContext& context) {
+  filter_program_map programs{};
+  collect_filters(segments, regexes, context, programs);
+  return programs;
+}
+
+}  // namespace libjsonpath
@@ -0,0 +1,259 @@
+#include <algorithm>  // std::lower_bound std::reverse std::sort
+#include <utility>    // std::move
+#include <vector>     // std::vector
+
+#include "libjsonpath/frozen.hpp"
+
+namespace py = pybind11;
+
+namespace libjsonpath {
+
+using namespace std::string_literals;
+
+FrozenDocument::FrozenDocument(py::handle obj) {
+  // A dict or list whose items are still being frozen. Nested data is
+  // tracked with an explicit stack, so it can't overflow the C++ stack.
+  struct Frame {
+    py::handle obj;
+    std::uint32_t index;
+    std::uint32_t position;
+    Py_ssize_t dict_position;
+  };
+
+  std::vector<Frame> stack{};
+  auto visit = [&](py::handle item, std::uint32_t parent,
+                   std::uint32_t member) {
+    auto index{freeze(item, parent, member)};
+    auto kind{m_nodes[index].kind};
+    if (kind == TapeKind::array || kind == TapeKind::object) {
+      stack.push_back(Frame{item, index, 0, 0});
+    }
+    return index;
+  };
+
+  visit(obj, NO_PARENT, 0);
+  while (!stack.empty()) {
+    auto& frame{stack.back()};
+    const auto& node{m_nodes[frame.index]};
+    if (frame.position == node.size) {
+      if (node.kind == TapeKind::object) {
+        index_members(frame.index);
+      }
+      stack.pop_back();
+      continue;
+    }
+
+    // Freezing an item can grow the tape and the stack, so take what's
+    // needed from the frame and its node first.
+    auto parent{frame.index};
+    auto position{frame.position++};
+    auto slot{node.children + position};
+
+    std::uint32_t child{0};
+    if (node.kind == TapeKind::object) {
+      PyObject* key{nullptr};
+      PyObject* value{nullptr};
+      PyDict_Next(frame.obj.ptr(), &frame.dict_position, &key, &value);
+      if (!PyUnicode_Check(key)) {
+        throw py::type_error("can't freeze a dict with non-string keys");
+      }
+      auto id{intern(py::handle{key}.cast<std::string_view>())};
+      child = visit(value, parent, id);
+    } else {
+      auto item{PyList_GET_ITEM(frame.obj.ptr(), position)};
+      child = visit(item, parent, position);
+    }
+    m_children[slot] = child;
+  }
+}
+
+std::uint32_t FrozenDocument::freeze(py::handle obj, std::uint32_t parent,
+                                     std::uint32_t member) {
+  if (m_nodes.size() >= NO_PARENT) {
+    throw py::value_error("document is too large to freeze");
+  }
+
+  auto index{static_cast<std::uint32_t>(m_nodes.size())};
+  TapeNode node{};
+  node.parent = parent;
+  node.member = member;
+
+  if (obj.is_none()) {
+    node.kind = TapeKind::null;
+  } else if (PyBool_Check(obj.ptr())) {
+    node.kind = TapeKind::boolean;
+    node.boolean = obj.ptr() == Py_True;
+  } else if (PyLong_Check(obj.ptr())) {
+    int overflow{0};
+    long long value{PyLong_AsLongLongAndOverflow(obj.ptr(), &overflow)};
+    if (overflow) {
+      throw py::type_error("can't freeze an int that doesn't fit in 64 bits");
+    }
+    if (value == -1 && PyErr_Occurred()) {
+      throw py::error_already_set();
+    }
+    node.kind = TapeKind::integer;
+    node.integer = value;
+  } else if (PyFloat_Check(obj.ptr())) {
+    node.kind = TapeKind::number;
+    node.number = PyFloat_AS_DOUBLE(obj.ptr());
+  } else if (PyUnicode_Check(obj.ptr())) {
+    node.kind = TapeKind::string;
+    node.string = intern(obj.cast<std::string_view>());
+  } else if (PyDict_Check(obj.ptr())) {
+    node.kind = TapeKind::object;
+    node.size = static_cast<std::uint32_t>(PyDict_GET_SIZE(obj.ptr()));
+  } else if (PyList_Check(obj.ptr())) {
+    node.kind = TapeKind::array;
+    node.size = static_cast<std::uint32_t>(PyList_GET_SIZE(obj.ptr()));
+  } else {
+    throw py::type_error("can't freeze an object of type '"s +
+                         Py_TYPE(obj.ptr())->tp_name + "'"s);
+  }
+
+  if (node.size) {
+    node.children = static_cast<std::uint32_t>(m_children.size());
+    m_children.resize(m_children.size() + node.size);
+  }
+
+  m_nodes.push_back(node);
+  return index;
+}
+
+std::uint32_t FrozenDocument::intern(std::string_view value) {
+  auto it{m_string_ids.find(value)};
+  if (it != m_string_ids.end()) {
+    return it->second;
+  }
+
+  auto id{static_cast<std::uint32_t>(m_strings.size())};
+  m_strings.emplace_back(value);
+  m_string_ids.emplace(m_strings.back(), id);
+  return id;
+}
+
+void FrozenDocument::index_members(std::uint32_t index) {
+  auto& node{m_nodes[index]};
+  node.members = static_cast<std::uint32_t>(m_members.size());
+  auto first{m_children.begin() + node.children};
+  m_members.insert(m_members.end(), first, first + node.size);
+  std::sort(m_members.begin() + node.members, m_members.end(),
+            [this](std::uint32_t left, std::uint32_t right) {
+              return m_nodes[left].member < m_nodes[right].member;
+            });
+}
+
+std::optional<std::uint32_t> FrozenDocument::string_id(
+    std::string_view value) const {
+  auto it{m_string_ids.find(value)};
+  if (it == m_string_ids.end()) {
+    return std::nullopt;
+  }
+  return it->second;
+}
+
+std::optional<std::uint32_t> FrozenDocument::member(std::uint32_t index,
+                                                    std::uint32_t key) const {
+  const auto& node{m_nodes[index]};
+  if (node.kind != TapeKind::object) {
+    return std::nullopt;
+  }
+
+  auto first{m_members.begin() + node.members};
+  auto last{first + node.size};
+  auto it{std::lower_bound(first, last, key,
+                           [this](std::uint32_t child, std::uint32_t key_) {
+                             return m_nodes[child].member < key_;
+                           })};
+  if (it == last || m_nodes[*it].member != key) {
+    return std::nullopt;
+  }
+  return *it;
+}
+
+py::object FrozenDocument::to_python(std::uint32_t index) const {
+  // A list or dict whose items are still being converted. Containers are
+  // added to their parent when they are created, and filled in later.
+  struct Frame {
+    py::handle obj;
+    std::uint32_t index;
+    std::uint32_t position;
+  };
+
+  std::vector<Frame> stack{};
+  auto convert = [&](std::uint32_t index_) -> py::object {
+    const auto& node{m_nodes[index_]};
+    switch (node.kind) {
+      case TapeKind::null:
+        return py::none();
+      case TapeKind::boolean:
+        return py::bool_(node.boolean);
+      case TapeKind::integer:
+        return py::int_(node.integer);
+      case TapeKind::number:
+        return py::float_(node.number);
+      case TapeKind::string:
+        return py::str(string(node.string));
+      case TapeKind::array: {
+        py::list list(node.size);
+        stack.push_back(Frame{list, index_, 0});
+        return list;
+      }
+      case TapeKind::object: {
+        py::dict dict{};
+        stack.push_back(Frame{dict, index_, 0});
+        return dict;
+      }
+      default:
+        return py::none();
+    }
+  };
+
+  auto rv{convert(index)};
+  while (!stack.empty()) {
+    auto& frame{stack.back()};
+    const auto& node{m_nodes[frame.index]};
+    if (frame.position == node.size) {
+      stack.pop_back();
+      continue;
+    }
+
+    // Converting an item can grow the stack.
+    auto obj{frame.obj};
+    auto position{frame.position++};
+    auto child_index{child(frame.index, position)};
+    auto value{convert(child_index)};
+
+    if (node.kind == TapeKind::array) {
+      PyList_SET_ITEM(obj.ptr(), position, value.release().ptr());
+    } else {
+      py::str key{string(m_nodes[child_index].member)};
+      if (PyDict_SetItem(obj.ptr(), key.ptr(), value.ptr()) < 0) {
+        throw py::error_already_set();
+      }
+    }
+  }
+  return rv;
+}
+
+location_link_t FrozenDocument::location(std::uint32_t index,
+                                         location_link_t base) const {
+  std::vector<std::uint32_t> steps{};
+  for (auto i{index}; m_nodes[i].parent != NO_PARENT; i = m_nodes[i].parent) {
+    steps.push_back(i);
+  }
+  std::reverse(steps.begin(), steps.end());
+
+  location_link_t link{std::move(base)};
+  for (auto step : steps) {
+    const auto& node{m_nodes[step]};
+    if (m_nodes[node.parent].kind == TapeKind::object) {
+      link = extend_location(link, py::str(string(node.member)));
+    } else {
+      link = extend_location(link, static_cast<size_t>(node.member));
+    }
+  }
+  return link;
+}
+
+}  // namespace libjsonpath
@@ -0,0 +1,698 @@
+#include <charconv>  // std::from_chars std::to_chars
+#include <cmath>     // std::isinf std::isnan
+#include <cstdint>   // std::int64_t std::uint32_t
+#include <cstdlib>   // std::strtod
+#include <limits>    // std::numeric_limits
+#include <string>    // std::string std::to_string
+#include <utility>   // std::pair
+#include <vector>    // std::vector
+
+#include "libjsonpath/frozen.hpp"
+
+namespace py = pybind11;
+
+namespace libjsonpath {
+
+using namespace std::string_literals;
+
+namespace {
+
+bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+bool is_whitespace(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+// Return true if _value_ is well-formed UTF-8 without surrogates.
+bool valid_utf8(std::string_view value) {
+  std::size_t i{0};
+  while (i < value.size()) {
+    auto c{static_cast<unsigned char>(value[i])};
+    if (c < 0x80) {
+      i++;
+      continue;
+    }
+
+    std::size_t length{0};
+    std::uint32_t code_point{0};
+    if ((c & 0xE0) == 0xC0) {
+      length = 2;
+      code_point = c & 0x1F;
+    } else if ((c & 0xF0) == 0xE0) {
+      length = 3;
+      code_point = c & 0x0F;
+    } else if ((c & 0xF8) == 0xF0) {
+      length = 4;
+      code_point = c & 0x07;
+    } else {
+      return false;
+    }
+
+    if (i + length > value.size()) {
+      return false;
+    }
+
+    for (std::size_t j{1}; j < length; j++) {
+      auto continuation{static_cast<unsigned char>(value[i + j])};
+      if ((continuation & 0xC0) != 0x80) {
+        return false;
+      }
+      code_point = (code_point << 6) | (continuation & 0x3F);
+    }
+
+    if ((length == 2 && code_point < 0x80) ||
+        (length == 3 && code_point < 0x800) ||
+        (length == 4 && code_point < 0x10000) || code_point > 0x10FFFF ||
+        (code_point >= 0xD800 && code_point <= 0xDFFF)) {
+      return false;
+    }
+
+    i += length;
+  }
+  return true;
+}
+
+void encode_utf8(std::uint32_t code_point, std::string& out) {
+  if (code_point < 0x80) {
+    out.push_back(static_cast<char>(code_point));
+  } else if (code_point < 0x800) {
+    out.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+    out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else if (code_point < 0x10000) {
+    out.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+    out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else {
+    out.push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+    out.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  }
+}
+
+void write_json_string(std::string_view value, std::string& out) {
+  static constexpr char hex[]{"0123456789abcdef"};
+  out.push_back('"');
+  for (auto c : value) {
+    switch (c) {
+      case '"':
+        out.append("\\\"");
+        break;
+      case '\\':
+        out.append("\\\\");
+        break;
+      case '\b':
+        out.append("\\b");
+        break;
+      case '\f':
+        out.append("\\f");
+        break;
+      case '\n':
+        out.append("\\n");
+        break;
+      case '\r':
+        out.append("\\r");
+        break;
+      case '\t':
+        out.append("\\t");
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          out.append("\\u00");
+          out.push_back(hex[c >> 4]);
+          out.push_back(hex[c & 0xF]);
+        } else {
+          out.push_back(c);
+        }
+    }
+  }
+  out.push_back('"');
+}
+
+// Write the shortest representation of _value_ that reads back the same.
+// Like json.dumps, whole numbers keep a fraction so they read back as
+// floats, and NaN and infinities are written as NaN and Infinity.
+void write_json_number(double value, std::string& out) {
+  if (std::isnan(value)) {
+    out.append("NaN");
+  } else if (std::isinf(value)) {
+    out.append(value < 0 ? "-Infinity" : "Infinity");
+  } else {
+    char buf[32];
+    auto [end, _]{std::to_chars(buf, buf + sizeof(buf), value)};
+    std::string_view text{buf, static_cast<std::size_t>(end - buf)};
+    out.append(text);
+    if (text.find_first_of(".e") == std::string_view::npos) {
+      out.append(".0");
+    }
+  }
+}
+
+}  // namespace
+
+// A JSON parser that writes nodes straight to a FrozenDocument's tape.
+// Arrays and objects are tracked with an explicit stack, so deeply nested
+// input can't overflow the C++ stack.
+//
+// Like Python's json module, NaN, Infinity and -Infinity are accepted, and
+// the last value wins when an object has duplicate keys.
+class JSONParser {
+public:
+  JSONParser(std::string_view json, FrozenDocument& doc)
+      : m_json{json}, m_doc{doc} {}
+
+  void parse();
+
+private:
+  // An array or object that is still being parsed.
+  struct Frame {
+    std::uint32_t index;
+
+    // The offset of this container's first item in m_pending.
+    std::size_t start;
+
+    // The interned key of the object member being parsed.
+    std::uint32_t key;
+
+    // Where the node index of the item being parsed goes in m_pending.
+    std::size_t slot;
+
+    // The offset of this object's first entry in m_replaced.
+    std::size_t replaced;
+  };
+
+  std::string_view m_json;
+  std::size_t m_pos{0};
+  FrozenDocument& m_doc;
+
+  std::vector<Frame> m_stack{};
+
+  // Node indices of items belonging to containers on the stack. They are
+  // moved to the document's child table when their container is closed.
+  std::vector<std::uint32_t> m_pending{};
+
+  // The index of an object and the position of a key within it.
+  using seen_key_t = std::pair<std::uint32_t, std::uint32_t>;
+
+  // For each interned string, the object it was last seen as a key of. Used
+  // to find duplicate keys.
+  std::vector<seen_key_t> m_keys{};
+
+  // Entries of m_keys overwritten by objects on the stack, restored when
+  // the object is closed. Without them, a nested object would hide the keys
+  // its parent has already seen.
+  std::vector<std::pair<std::uint32_t, seen_key_t>> m_replaced{};
+
+  // Decoded strings that contain escape sequences.
+  std::string m_scratch{};
+
+  [[noreturn]] void error(const std::string& message) const {
+    throw py::value_error(message + " at offset "s + std::to_string(m_pos));
+  }
+
+  char peek() const { return m_pos < m_json.size() ? m_json[m_pos] : '\0'; }
+
+  void skip_whitespace() {
+    while (m_pos < m_json.size() && is_whitespace(m_json[m_pos])) {
+      m_pos++;
+    }
+  }
+
+  void expect(char c) {
+    skip_whitespace();
+    if (peek() != c) {
+      error("expected '"s + c + "'"s);
+    }
+    m_pos++;
+  }
+
+  bool consume(std::string_view word) {
+    if (m_json.substr(m_pos, word.size()) == word) {
+      m_pos += word.size();
+      return true;
+    }
+    return false;
+  }
+
+  // Return a new node positioned as the next item of the innermost container.
+  TapeNode new_node(TapeKind kind) const;
+
+  // Append _node_ to the tape and return its index.
+  std::uint32_t push(const TapeNode& node);
+
+  // Claim a slot for the next item of the innermost container, reading its
+  // key first if the container is an object.
+  void item();
+
+  void open(TapeKind kind);
+  std::uint32_t close();
+
+  std::uint32_t scalar();
+  void number(TapeNode& node);
+  std::string_view string();
+  std::uint32_t hex4();
+};
+
+TapeNode JSONParser::new_node(TapeKind kind) const {
+  TapeNode node{};
+  node.kind = kind;
+
+  if (m_stack.empty()) {
+    node.parent = NO_PARENT;
+    node.member = 0;
+    return node;
+  }
+
+  const auto& frame{m_stack.back()};
+  node.parent = frame.index;
+  if (m_doc.m_nodes[frame.index].kind == TapeKind::object) {
+    node.member = frame.key;
+  } else {
+    node.member = static_cast<std::uint32_t>(frame.slot - frame.start);
+  }
+  return node;
+}
+
+std::uint32_t JSONParser::push(const TapeNode& node) {
+  if (m_doc.m_nodes.size() >= NO_PARENT) {
+    throw py::value_error("document is too large to freeze");
+  }
+  auto index{static_cast<std::uint32_t>(m_doc.m_nodes.size())};
+  m_doc.m_nodes.push_back(node);
+  return index;
+}
+
+void JSONParser::item() {
+  auto& frame{m_stack.back()};
+
+  if (m_doc.m_nodes[frame.index].kind == TapeKind::object) {
+    skip_whitespace();
+    if (peek() != '"') {
+      error("expected a string key");
+    }
+    frame.key = m_doc.intern(string());
+    expect(':');
+
+    if (frame.key >= m_keys.size()) {
+      m_keys.resize(m_doc.m_strings.size(), {NO_PARENT, 0});
+    }
+
+    auto& seen{m_keys[frame.key]};
+    if (seen.first == frame.index) {
+      // A duplicate key. Its new value replaces the old one in place.
+      frame.slot = frame.start + seen.second;
+      return;
+    }
+    m_replaced.emplace_back(frame.key, seen);
+    seen = {frame.index,
+            static_cast<std::uint32_t>(m_pending.size() - frame.start)};
+  }
+
+  frame.slot = m_pending.size();
+  m_pending.push_back(0);
+}
+
+void JSONParser::open(TapeKind kind) {
+  auto index{push(new_node(kind))};
+  m_stack.push_back(Frame{index, m_pending.size(), 0, 0, m_replaced.size()});
+}
+
+std::uint32_t JSONParser::close() {
+  auto frame{m_stack.back()};
+  m_stack.pop_back();
+
+  auto& node{m_doc.m_nodes[frame.index]};
+  node.children = static_cast<std::uint32_t>(m_doc.m_children.size());
+  node.size = static_cast<std::uint32_t>(m_pending.size() - frame.start);
+  m_doc.m_children.insert(m_doc.m_children.end(),
+                          m_pending.begin() + frame.start, m_pending.end());
+  m_pending.resize(frame.start);
+
+  if (node.kind == TapeKind::object) {
+    m_doc.index_members(frame.index);
+  }
+
+  while (m_replaced.size() > frame.replaced) {
+    auto [key, seen]{m_replaced.back()};
+    m_keys[key] = seen;
+    m_replaced.pop_back();
+  }
+  return frame.index;
+}
+
+void JSONParser::parse() {
+  // Skip a UTF-8 byte order mark, like json.loads does for bytes.
+  consume("\xEF\xBB\xBF");
+
+  std::uint32_t value{0};
+  bool want_value{true};
+
+  for (;;) {
+    if (want_value) {
+      skip_whitespace();
+      auto c{peek()};
+      if (c == '[' || c == '{') {
+        m_pos++;
+        open(c == '[' ? TapeKind::array : TapeKind::object);
+        skip_whitespace();
+        if (peek() == (c == '[' ? ']' : '}')) {
+          m_pos++;
+          value = close();
+          want_value = false;
+        } else {
+          item();
+        }
+        continue;
+      }
+
+      value = scalar();
+      want_value = false;
+    }
+
+    if (m_stack.empty()) {
+      break;
+    }
+
+    auto& frame{m_stack.back()};
+    m_pending[frame.slot] = value;
+
+    skip_whitespace();
+    auto is_object{m_doc.m_nodes[frame.index].kind == TapeKind::object};
+    auto c{peek()};
+    if (c == ',') {
+      m_pos++;
+      item();
+      want_value = true;
+    } else if (c == (is_object ? '}' : ']')) {
+      m_pos++;
+      value = close();
+    } else {
+      error(is_object ? "expected ',' or '}'"s : "expected ',' or ']'"s);
+    }
+  }
+
+  skip_whitespace();
+  if (m_pos != m_json.size()) {
+    error("unexpected data after JSON value");
+  }
+}
+
+std::uint32_t JSONParser::scalar() {
+  switch (peek()) {
+    case '"': {
+      auto node{new_node(TapeKind::string)};
+      node.string = m_doc.intern(string());
+      return push(node);
+    }
+    case 't':
+    case 'f': {
+      auto node{new_node(TapeKind::boolean)};
+      if (consume("true")) {
+        node.boolean = true;
+      } else if (consume("false")) {
+        node.boolean = false;
+      } else {
+        error("expected a value");
+      }
+      return push(node);
+    }
+    case 'n':
+      if (!consume("null")) {
+        error("expected a value");
+      }
+      return push(new_node(TapeKind::null));
+    default: {
+      TapeNode node{new_node(TapeKind::number)};
+      number(node);
+      return push(node);
+    }
+  }
+}
+
+void JSONParser::number(TapeNode& node) {
+  if (consume("NaN")) {
+    node.number = std::numeric_limits<double>::quiet_NaN();
+    return;
+  }
+
+  if (consume("Infinity")) {
+    node.number = std::numeric_limits<double>::infinity();
+    return;
+  }
+
+  if (consume("-Infinity")) {
+    node.number = -std::numeric_limits<double>::infinity();
+    return;
+  }
+
+  auto start{m_pos};
+  bool is_integer{true};
+
+  if (peek() == '-') {
+    m_pos++;
+  }
+
+  if (peek() == '0') {
+    m_pos++;
+  } else if (is_digit(peek())) {
+    while (is_digit(peek())) m_pos++;
+  } else {
+    error("expected a value");
+  }
+
+  if (peek() == '.') {
+    is_integer = false;
+    m_pos++;
+    if (!is_digit(peek())) {
+      error("expected a digit");
+    }
+    while (is_digit(peek())) m_pos++;
+  }
+
+  if (peek() == 'e' || peek() == 'E') {
+    is_integer = false;
+    m_pos++;
+    if (peek() == '+' || peek() == '-') {
+      m_pos++;
+    }
+    if (!is_digit(peek())) {
+      error("expected a digit");
+    }
+    while (is_digit(peek())) m_pos++;
+  }
+
+  const char* first{m_json.data() + start};
+  const char* last{m_json.data() + m_pos};
+
+  if (is_integer) {
+    std::int64_t value{0};
+    auto [_, ec]{std::from_chars(first, last, value)};
+    if (ec != std::errc{}) {
+      error("integer doesn't fit in 64 bits");
+    }
+    node.kind = TapeKind::integer;
+    node.integer = value;
+    return;
+  }
+
+  double value{0};
+  auto [_, ec]{std::from_chars(first, last, value)};
+  if (ec == std::errc::result_out_of_range) {
+    // from_chars doesn't round to infinity or zero like float() does.
+    m_scratch.assign(first, last);
+    value = std::strtod(m_scratch.c_str(), nullptr);
+  }
+  node.number = value;
+}
+
+std::uint32_t JSONParser::hex4() {
+  if (m_pos + 4 > m_json.size()) {
+    error("invalid \\u escape");
+  }
+
+  std::uint32_t value{0};
+  auto [ptr, ec]{std::from_chars(m_json.data() + m_pos,
+                                 m_json.data() + m_pos + 4, value, 16)};
+  if (ec != std::errc{} || ptr != m_json.data() + m_pos + 4) {
+    error("invalid \\u escape");
+  }
+  m_pos += 4;
+  return value;
+}
+
+std::string_view JSONParser::string() {
+  m_pos++;  // opening quote
+  auto start{m_pos};
+
+  // Most strings don't contain escape sequences. They are used in place.
+  while (m_pos < m_json.size()) {
+    auto c{static_cast<unsigned char>(m_json[m_pos])};
+    if (c == '"') {
+      auto value{m_json.substr(start, m_pos - start)};
+      if (!valid_utf8(value)) {
+        error("invalid UTF-8 in string");
+      }
+      m_pos++;
+      return value;
+    }
+    if (c == '\\') {
+      break;
+    }
+    if (c < 0x20) {
+      error("invalid control character in string");
+    }
+    m_pos++;
+  }
+
+  m_scratch.assign(m_json.substr(start, m_pos - start));
+
+  for (;;) {
+    if (m_pos >= m_json.size()) {
+      error("unterminated string");
+    }
+
+    auto c{static_cast<unsigned char>(m_json[m_pos++])};
+    if (c == '"') {
+      break;
+    }
+    if (c < 0x20) {
+      error("invalid control character in string");
+    }
+    if (c != '\\') {
+      m_scratch.push_back(static_cast<char>(c));
+      continue;
+    }
+
+    switch (peek()) {
+      case '"':
+      case '\\':
+      case '/':
+        m_scratch.push_back(m_json[m_pos]);
+        break;
+      case 'b':
+        m_scratch.push_back('\b');
+        break;
+      case 'f':
+        m_scratch.push_back('\f');
+        break;
+      case 'n':
+        m_scratch.push_back('\n');
+        break;
+      case 'r':
+        m_scratch.push_back('\r');
+        break;
+      case 't':
+        m_scratch.push_back('\t');
+        break;
+      case 'u': {
+        m_pos++;
+        auto code_point{hex4()};
+        if (code_point >= 0xD800 && code_point <= 0xDBFF &&
+            consume("\\u")) {
+          auto low{hex4()};
+          if (low < 0xDC00 || low > 0xDFFF) {
+            error("unpaired surrogate in \\u escape");
+          }
+          code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+        } else if (code_point >= 0xD800 && code_point <= 0xDFFF) {
+          error("unpaired surrogate in \\u escape");
+        }
+        encode_utf8(code_point, m_scratch);
+        continue;
+      }
+      default:
+        error("invalid escape sequence");
+    }
+    m_pos++;
+  }
+
+  if (!valid_utf8(m_scratch)) {
+    error("invalid UTF-8 in string");
+  }
+  return m_scratch;
+}
+
+FrozenDocument FrozenDocument::from_json(std::string_view json) {
+  FrozenDocument doc{};
+  JSONParser{json, doc}.parse();
+  return doc;
+}
+
+FrozenDocument FrozenDocument::from_buffer(py::buffer buf) {
+  py::buffer_info info{buf.request()};
+  if (info.ndim != 1 || info.strides[0] != info.itemsize) {
+    throw py::type_error("expected a contiguous bytes-like object");
+  }
+
+  std::string_view json{static_cast<const char*>(info.ptr),
+                        static_cast<std::size_t>(info.size * info.itemsize)};
+  py::gil_scoped_release release{};
+  return from_json(json);
+}
+
+std::string FrozenDocument::to_json(std::uint32_t index) const {
+  std::string out{};
+  write_json(index, out);
+  return out;
+}
+
+void FrozenDocument::write_json(std::uint32_t index, std::string& out) const {
+  // An array or object whose items are still being written.
+  struct Frame {
+    std::uint32_t index;
+    std::uint32_t position;
+  };
+
+  std::vector<Frame> stack{};
+  auto write = [&](std::uint32_t index_) {
+    const auto& node{m_nodes[index_]};
+    switch (node.kind) {
+      case TapeKind::null:
+        out.append("null");
+        break;
+      case TapeKind::boolean:
+        out.append(node.boolean ? "true" : "false");
+        break;
+      case TapeKind::integer:
+        out.append(std::to_string(node.integer));
+        break;
+      case TapeKind::number:
+        write_json_number(node.number, out);
+        break;
+      case TapeKind::string:
+        write_json_string(string(node.string), out);
+        break;
+      case TapeKind::array:
+        out.push_back('[');
+        stack.push_back(Frame{index_, 0});
+        break;
+      case TapeKind::object:
+        out.push_back('{');
+        stack.push_back(Frame{index_, 0});
+        break;
+    }
+  };
+
+  write(index);
+  while (!stack.empty()) {
+    auto& frame{stack.back()};
+    const auto& node{m_nodes[frame.index]};
+    if (frame.position == node.size) {
+      out.push_back(node.kind == TapeKind::array ? ']' : '}');
+      stack.pop_back();
+      continue;
+    }
+
+    if (frame.position) {
+      out.push_back(',');
+    }
+    auto child_index{child(frame.index, frame.position++)};
+    if (node.kind == TapeKind::object) {
+      write_json_string(string(m_nodes[child_index].member), out);
+      out.push_back(':');
+    }
+    write(child_index);
+  }
+}
+
+}  // namespace libjsonpath
@@ -0,0 +1,641 @@
+#include <cstdint>        // std::int64_t std::uint32_t
+#include <limits>         // std::numeric_limits
+#include <optional>       // std::optional
+#include <string>         // std::string
+#include <string_view>    // std::string_view
+#include <unordered_map>  // std::unordered_map
+#include <utility>        // std::move std::pair
+#include <variant>        // std::variant std::visit
+#include <vector>         // std::vector
+
+#include "libjsonpath/evaluate.hpp"
+#include "libjsonpath/exceptions.hpp"
+#include "libjsonpath/frozen.hpp"
+#include "libjsonpath/jsonpath.hpp"
+#include "libjsonpath/numbers.hpp"
+#include "libjsonpath/path.hpp"
+#include "libjsonpath/regex.hpp"
+#include "libjsonpath/selectors.hpp"
+
+namespace py = pybind11;
+
+namespace libjsonpath {
+
+// Node indices into a FrozenDocument.
+using tape_nodes_t = std::vector<std::uint32_t>;
+
+// Thrown when a query calls a function extension implemented in Python,
+// which can only be applied to Python objects.
+struct NeedsPython {};
+
+// The absence of a value, like NOTHING.
+struct Nothing {};
+
+// An array or object node, compared by value.
+struct TapeRef {
+  std::uint32_t index;
+};
+
+using tape_value_t = std::variant<Nothing, std::nullptr_t, bool, std::int64_t,
+                                  double, std::string_view, TapeRef>;
+
+tape_value_t tape_value(const FrozenDocument& doc, std::uint32_t index) {
+  const auto& node{doc.node(index)};
+  switch (node.kind) {
+    case TapeKind::null:
+      return nullptr;
+    case TapeKind::boolean:
+      return node.boolean;
+    case TapeKind::integer:
+      return node.integer;
+    case TapeKind::number:
+      return node.number;
+    case TapeKind::string:
+      return doc.string(node.string);
+    default:
+      return TapeRef{index};
+  }
+}
+
+bool is_number(const tape_value_t& value) {
+  return std::holds_alternative<bool>(value) ||
+         std::holds_alternative<std::int64_t>(value) ||
+         std::holds_alternative<double>(value);
+}
+
+// Return -1, 0 or 1 if the number _left_ is less than, equal to or greater
+// than the number _right_, or nothing if they are unordered. Booleans are
+// zero or one, like they are in Python.
+std::optional<int> compare_tape_numbers(const tape_value_t& left,
+                                        const tape_value_t& right) {
+  auto integer = [](const tape_value_t& value) -> std::optional<std::int64_t> {
+    if (auto boolean{std::get_if<bool>(&value)}) {
+      return *boolean ? 1 : 0;
+    }
+    if (auto integer_{std::get_if<std::int64_t>(&value)}) {
+      return *integer_;
+    }
+    return std::nullopt;
+  };
+
+  auto left_integer{integer(left)};
+  auto right_integer{integer(right)};
+  if (left_integer && right_integer) {
+    return compare_numbers(*left_integer, *right_integer);
+  }
+  if (left_integer) {
+    return compare_numbers(*left_integer, std::get<double>(right));
+  }
+  if (right_integer) {
+    return compare_numbers(std::get<double>(left), *right_integer);
+  }
+  return compare_numbers(std::get<double>(left), std::get<double>(right));
+}
+
+bool value_equals(const FrozenDocument& doc, const tape_value_t& left,
+                  const tape_value_t& right);
+
+// Compare the nodes at _left_ and _right_ by value. Pairs of arrays and
+// objects still to be compared are kept on an explicit stack, so deeply
+// nested values can't overflow the C++ stack.
+bool node_equals(const FrozenDocument& doc, std::uint32_t left,
+                 std::uint32_t right) {
+  std::vector<std::pair<std::uint32_t, std::uint32_t>> pending{{left, right}};
+
+  while (!pending.empty()) {
+    auto [left_, right_]{pending.back()};
+    pending.pop_back();
+
+    const auto& left_node{doc.node(left_)};
+    const auto& right_node{doc.node(right_)};
+
+    if (left_node.kind == TapeKind::array &&
+        right_node.kind == TapeKind::array) {
+      if (left_node.size != right_node.size) {
+        return false;
+      }
+      for (std::uint32_t i{0}; i < left_node.size; i++) {
+        pending.emplace_back(doc.child(left_, i), doc.child(right_, i));
+      }
+      continue;
+    }
+
+    if (left_node.kind == TapeKind::object &&
+        right_node.kind == TapeKind::object) {
+      if (left_node.size != right_node.size) {
+        return false;
+      }
+      for (std::uint32_t i{0}; i < left_node.size; i++) {
+        auto child{doc.child(left_, i)};
+        auto other{doc.member(right_, doc.node(child).member)};
+        if (!other) {
+          return false;
+        }
+        pending.emplace_back(child, *other);
+      }
+      continue;
+    }
+
+    auto left_value{tape_value(doc, left_)};
+    auto right_value{tape_value(doc, right_)};
+
+    // An array is never equal to an object.
+    if (std::holds_alternative<TapeRef>(left_value) &&
+        std::holds_alternative<TapeRef>(right_value)) {
+      return false;
+    }
+
+    if (!value_equals(doc, left_value, right_value)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Compare _left_ and _right_ the same way Python's == compares the values
+// they were frozen from.
+bool value_equals(const FrozenDocument& doc, const tape_value_t& left,
+                  const tape_value_t& right) {
+  // True == 1 and 1 == 1.0, but 2**53 + 1 != 2.0**53.
+  if (is_number(left) && is_number(right)) {
+    auto order{compare_tape_numbers(left, right)};
+    return order && *order == 0;
+  }
+
+  if (left.index() != right.index()) {
+    return false;
+  }
+
+  if (auto left_{std::get_if<std::string_view>(&left)}) {
+    return *left_ == std::get<std::string_view>(right);
+  }
+
+  if (auto left_{std::get_if<TapeRef>(&left)}) {
+    return node_equals(doc, left_->index, std::get<TapeRef>(right).index);
+  }
+
+  // Both null or both nothing.
+  return true;
+}
+
+// Return the number of code points in the UTF-8 encoded _value_.
+std::size_t code_point_length(std::string_view value) {
+  std::size_t length{0};
+  for (auto c : value) {
+    if ((static_cast<unsigned char>(c) & 0xC0) != 0x80) {
+      length++;
+    }
+  }
+  return length;
+}
+
+// Evaluates queries over a FrozenDocument. See evaluate.hpp. Nodes are
+// indices into the document, and their locations are only built for the
+// nodes a query returns.
+class TapeContext {
+public:
+  using node_t = std::uint32_t;
+  using nodes_t = tape_nodes_t;
+  using value_t = tape_value_t;
+  using current_t = std::uint32_t;
+  using filter_t = ExpressionFilter<TapeContext>;
+
+  TapeContext(const FrozenDocument& doc_, const EvaluationContext& context_,
+              const regex_map* regexes_)
+      : doc{doc_},
+        context{context_},
+        regexes{regexes_},
+        native_functions{context_.native_functions} {}
+
+  const FrozenDocument& doc;
+  const EvaluationContext& context;
+  const regex_map* regexes;
+  const native_function_map& native_functions;
+  const tape_value_t nothing{Nothing{}};
+
+  // Results of root queries embedded in filters, keyed by the address of the
+  // query.
+  mutable std::unordered_map<const RootQuery*, tape_nodes_t> root_queries{};
+
+  // Interned ids of names used by name selectors, keyed by the address of
+  // the selector. A name that isn't interned is not a key in the document.
+  mutable std::unordered_map<const NameSelector*, std::optional<std::uint32_t>>
+      names{};
+
+  std::optional<std::uint32_t> name_id(const NameSelector& selector) const {
+    auto it{names.find(&selector)};
+    if (it == names.end()) {
+      it = names.emplace(&selector, doc.string_id(selector.name)).first;
+    }
+    return it->second;
+  }
+
+  bool is_array(std::uint32_t index) const {
+    return doc.node(index).kind == TapeKind::array;
+  }
+
+  bool is_object(std::uint32_t index) const {
+    return doc.node(index).kind == TapeKind::object;
+  }
+
+  std::size_t size(std::uint32_t index) const { return doc.node(index).size; }
+
+  template <bool keep_locations>
+  std::optional<std::uint32_t> member(std::uint32_t index,
+                                      const NameSelector& selector) const {
+    if (!is_object(index)) {
+      return std::nullopt;
+    }
+    if (auto key{name_id(selector)}) {
+      return doc.member(index, *key);
+    }
+    return std::nullopt;
+  }
+
+  template <bool keep_locations>
+  std::uint32_t item(std::uint32_t index, std::size_t position) const {
+    return doc.child(index, static_cast<std::uint32_t>(position));
+  }
+
+  template <bool keep_locations, typename Test>
+  std::optional<std::uint32_t> next_child(std::uint32_t index,
+                                          std::size_t& position,
+                                          Test&& test) const {
+    if (!is_array(index) && !is_object(index)) {
+      return std::nullopt;
+    }
+    while (position < doc.node(index).size) {
+      auto child{doc.child(index, static_cast<std::uint32_t>(position++))};
+      if (test(child)) {
+        return child;
+      }
+    }
+    return std::nullopt;
+  }
+
+  tape_value_t null() const { return nullptr; }
+  tape_value_t boolean(bool value) const { return value; }
+
+  tape_value_t integer(std::int64_t value) const { return value; }
+  tape_value_t real(double value) const { return value; }
+
+  tape_value_t string(const std::string& value) const {
+    return std::string_view{value};
+  }
+
+  tape_value_t value(std::uint32_t index) const {
+    return tape_value(doc, index);
+  }
+
+  tape_value_t length(const tape_value_t& value) const {
+    if (auto string_{std::get_if<std::string_view>(&value)}) {
+      return static_cast<std::int64_t>(code_point_length(*string_));
+    }
+    if (auto ref{std::get_if<TapeRef>(&value)}) {
+      return static_cast<std::int64_t>(doc.node(ref->index).size);
+    }
+    return Nothing{};
+  }
+
+  bool is_false(const tape_value_t& value) const {
+    auto boolean_{std::get_if<bool>(&value)};
+    return boolean_ && !*boolean_;
+  }
+
+  bool is_nothing(const tape_value_t& value) const {
+    return std::holds_alternative<Nothing>(value);
+  }
+
+  bool equal(const tape_value_t& left, const tape_value_t& right) const {
+    return value_equals(doc, left, right);
+  }
+
+  bool less_than(const tape_value_t& left, const tape_value_t& right) const {
+    if (auto left_string{std::get_if<std::string_view>(&left)}) {
+      auto right_string{std::get_if<std::string_view>(&right)};
+      // UTF-8 byte order is code point order.
+      return right_string && *left_string < *right_string;
+    }
+
+    if (std::holds_alternative<bool>(left) ||
+        std::holds_alternative<bool>(right) || !is_number(left) ||
+        !is_number(right)) {
+      return false;
+    }
+
+    auto order{compare_tape_numbers(left, right)};
+    return order && *order < 0;
+  }
+
+  tape_nodes_t resolve(const segments_t& segments,
+                       std::uint32_t current) const;
+
+  bool exists(const segments_t& segments, std::uint32_t current) const;
+
+  const tape_nodes_t* root_query(const RootQuery& query) const {
+    auto it{root_queries.find(&query)};
+    if (it == root_queries.end()) {
+      it = root_queries.emplace(&query, resolve(query.query, 0)).first;
+    }
+    return &it->second;
+  }
+
+  const py::object* literal_regex(const FunctionCall& call) const {
+    if (regexes) {
+      auto it{regexes->find(&call)};
+      if (it != regexes->end()) {
+        return &it->second;
+      }
+    }
+    return nullptr;
+  }
+
+  // Regular expressions are Python patterns, so these are the only places
+  // tape evaluation takes the GIL.
+  bool regex_test(const tape_value_t& string, const py::object& regex,
+                  bool fullmatch) const {
+    auto string_{std::get_if<std::string_view>(&string)};
+    if (!string_) {
+      return false;
+    }
+
+    py::gil_scoped_acquire acquire{};
+    return search(*string_, regex, fullmatch);
+  }
+
+  bool pattern_test(const tape_value_t& string, const tape_value_t& pattern,
+                    bool fullmatch) const {
+    auto string_{std::get_if<std::string_view>(&string)};
+    auto pattern_{std::get_if<std::string_view>(&pattern)};
+    if (!string_ || !pattern_) {
+      return false;
+    }
+
+    py::gil_scoped_acquire acquire{};
+    py::object regex{context.regex_cache ? context.regex_cache->get(*pattern_)
+                                         : compile_regex(*pattern_)};
+    return search(*string_, regex, fullmatch);
+  }
+
+  template <typename Visitor>
+  typename Visitor::rv_t call_extension(const FunctionCall&,
+                                        const Visitor&) const {
+    throw NeedsPython{};
+  }
+
+private:
+  // The GIL must be held.
+  static bool search(std::string_view string, const py::object& regex,
+                     bool fullmatch) {
+    py::str value{string.data(), string.size()};
+    return fullmatch ? regex_fullmatch(regex, value)
+                     : regex_search(regex, value);
+  }
+};
+
+// Node indices are appended to a list, until it has _limit_ nodes.
+struct TapeNodeOutput {
+  static constexpr bool keeps_locations{false};
+  static constexpr std::size_t unlimited{
+      std::numeric_limits<std::size_t>::max()};
+  tape_nodes_t& nodes;
+  std::size_t limit{unlimited};
+
+  void push(std::uint32_t index) { nodes.push_back(index); }
+
+  bool done() const { return nodes.size() >= limit; }
+};
+
+// Selection stops as soon as any node is selected.
+struct TapeExistsOutput {
+  static constexpr bool keeps_locations{false};
+  bool found{false};
+
+  void push(std::uint32_t) { found = true; }
+
+  bool done() const { return found; }
+};
+
+tape_nodes_t TapeContext::resolve(const segments_t& segments,
+                                  std::uint32_t current) const {
+  tape_nodes_t nodes{};
+  TapeNodeOutput out{nodes};
+  resolve_node(*this, segments.begin(), segments.end(), current, out);
+  return nodes;
+}
+
+bool TapeContext::exists(const segments_t& segments,
+                         std::uint32_t current) const {
+  TapeExistsOutput out{};
+  resolve_node(*this, segments.begin(), segments.end(), current, out);
+  return out.found;
+}
+
+std::optional<tape_nodes_t> resolve_frozen_unlocked(
+    const FrozenDocument& doc, const EvaluationContext& context,
+    const ParsedQuery& query, segments_t::const_iterator first,
+    std::size_t limit) {
+  try {
+    TapeContext t_ctx{doc, context, &query.regexes};
+    tape_nodes_t nodes{};
+    TapeNodeOutput out{nodes, limit};
+    resolve_node(t_ctx, first, query.segments.end(), 0u, out);
+    return nodes;
+  } catch (const NeedsPython&) {
+    return std::nullopt;
+  }
+}
+
+std::optional<tape_nodes_t> resolve_frozen(const FrozenDocument& doc,
+                                           const EvaluationContext& context,
+                                           const ParsedQuery& query,
+                                           segments_t::const_iterator first,
+                                           std::size_t limit) {
+  py::gil_scoped_release release{};
+  return resolve_frozen_unlocked(doc, context, query, first, limit);
+}
+
+std::optional<bool> test_frozen(const FrozenDocument& doc,
+                                const EvaluationContext& context,
+                                const ParsedQuery& query,
+                                const FilterSelector& selector) {
+  try {
+    py::gil_scoped_release release{};
+    TapeContext t_ctx{doc, context, &query.regexes};
+    ExpressionFilter<TapeContext> filter{t_ctx, selector};
+    return filter.test(0);
+  } catch (const NeedsPython&) {
+    return std::nullopt;
+  }
+}
+
+JSONPathNodeList Path_::query(const FrozenDocument& doc,
+                              std::optional<std::size_t> limit) const {
+  auto nodes{resolve_frozen(doc, *m_context, *m_query,
+                            m_query->segments.begin(),
+                            limit.value_or(TapeNodeOutput::unlimited))};
+  if (!nodes) {
+    return query(doc.to_python(), limit);
+  }
+
+  JSONPathNodeList rv{};
+  rv.reserve(nodes->size());
+  for (auto index : *nodes) {
+    rv.emplace_back(doc.to_python(index), doc.location(index));
+  }
+  return rv;
+}
+
+py::list Path_::findall(const FrozenDocument& doc) const {
+  auto nodes{
+      resolve_frozen(doc, *m_context, *m_query, m_query->segments.begin(),
+                     TapeNodeOutput::unlimited)};
+  if (!nodes) {
+    return findall(doc.to_python());
+  }
+
+  py::list rv{};
+  for (auto index : *nodes) {
+    rv.append(doc.to_python(index));
+  }
+  return rv;
+}
+
+bool Path_::exists(const FrozenDocument& doc) const {
+  auto nodes{resolve_frozen(doc, *m_context, *m_query,
+                            m_query->segments.begin(), 1)};
+  if (!nodes) {
+    return exists(doc.to_python());
+  }
+  return !nodes->empty();
+}
+
+std::optional<JSONPathNode> Path_::first(const FrozenDocument& doc) const {
+  auto nodes{query(doc, 1)};
+  if (nodes.empty()) {
+    return std::nullopt;
+  }
+  return std::move(nodes[0]);
+}
+
+std::size_t Path_::count(const FrozenDocument& doc) const {
+  auto nodes{
+      resolve_frozen(doc, *m_context, *m_query, m_query->segments.begin(),
+                     TapeNodeOutput::unlimited)};
+  if (!nodes) {
+    return count(doc.to_python());
+  }
+  return nodes->size();
+}
+
+FrozenNodeIterator Path_::iter(const FrozenDocument& doc) const {
+  auto nodes{
+      resolve_frozen(doc, *m_context, *m_query, m_query->segments.begin(),
+                     TapeNodeOutput::unlimited)};
+  if (!nodes) {
+    return FrozenNodeIterator{iter(doc.to_python())};
+  }
+  return FrozenNodeIterator{doc, std::move(*nodes)};
+}
+
+FrozenNodeIterator::FrozenNodeIterator(const FrozenDocument& doc,
+                                       std::vector<std::uint32_t> nodes)
+    : m_doc{&doc}, m_nodes{std::move(nodes)} {}
+
+FrozenNodeIterator::FrozenNodeIterator(NodeIterator fallback)
+    : m_fallback{std::move(fallback)} {}
+
+std::optional<JSONPathNode> FrozenNodeIterator::next() {
+  if (m_fallback) {
+    return m_fallback->next();
+  }
+  if (m_position >= m_nodes.size()) {
+    return std::nullopt;
+  }
+  auto index{m_nodes[m_position++]};
+  return JSONPathNode{m_doc->to_python(index), m_doc->location(index)};
+}
+
+std::vector<JSONPathNodeList> QuerySet::query(
+    const FrozenDocument& doc) const {
+  std::vector<tape_nodes_t> matches{};
+  matches.reserve(m_queries.size());
+  for (const auto& query_ : m_queries) {
+    auto nodes{resolve_frozen(doc, *m_context, *query_,
+                              query_->segments.begin(),
+                              TapeNodeOutput::unlimited)};
+    if (!nodes) {
+      return query(doc.to_python());
+    }
+    matches.push_back(std::move(*nodes));
+  }
+
+  std::vector<JSONPathNodeList> results(m_queries.size());
+  for (std::size_t i{0}; i < matches.size(); i++) {
+    results[i].reserve(matches[i].size());
+    for (auto index : matches[i]) {
+      results[i].emplace_back(doc.to_python(index), doc.location(index));
+    }
+  }
+  return results;
+}
+
+py::list QuerySet::findall(const FrozenDocument& doc) const {
+  py::list values{};
+  for (const auto& nodes : query(doc)) {
+    py::list values_{};
+    for (const auto& node : nodes) {
+      values_.append(node.value);
+    }
+    values.append(values_);
+  }
+  return values;
+}
+
+JSONPathNodeList Path_::query_bytes(py::buffer buf,
+                                    std::optional<std::size_t> limit) const {
+  return query(FrozenDocument::from_buffer(std::move(buf)), limit);
+}
+
+py::list Path_::findall_bytes(py::buffer buf) const {
+  return findall(FrozenDocument::from_buffer(std::move(buf)));
+}
+
+JSONPathNodeList Env_::query(std::string_view path, const FrozenDocument& doc,
+                             std::optional<std::size_t> limit) {
+  return compile(path).query(doc, limit);
+}
+
+py::list Env_::findall(std::string_view path, const FrozenDocument& doc) {
+  return compile(path).findall(doc);
+}
+
+bool Env_::exists(std::string_view path, const FrozenDocument& doc) {
+  return compile(path).exists(doc);
+}
+
+std::optional<JSONPathNode> Env_::first(std::string_view path,
+                                        const FrozenDocument& doc) {
+  return compile(path).first(doc);
+}
+
+std::size_t Env_::count(std::string_view path, const FrozenDocument& doc) {
+  return compile(path).count(doc);
+}
+
+FrozenNodeIterator Env_::iter(std::string_view path,
+                              const FrozenDocument& doc) {
+  return compile(path).iter(doc);
+}
+
+JSONPathNodeList Env_::query_bytes(std::string_view path, py::buffer buf,
+                                   std::optional<std::size_t> limit) {
+  return compile(path).query_bytes(std::move(buf), limit);
+}
+
+py::list Env_::findall_bytes(std::string_view path, py::buffer buf) {
+  return compile(path).findall_bytes(std::move(buf));
+}
+
+}  // namespace libjsonpath
@@ -0,0 +1,30 @@
+#include "libjsonpath/functions.hpp"
+
+namespace py = pybind11;
+
+namespace libjsonpath {
+
+py::object count_(const JSONPathNodeList& nodes) {
+  return py::int_(nodes.size());
+}
+
+py::object length_(py::handle obj, py::handle nothing) {
+  Py_ssize_t length{PyObject_Size(obj.ptr())};
+  if (length < 0) {
+    if (!PyErr_ExceptionMatches(PyExc_TypeError)) {
+      throw py::error_already_set();
+    }
+    PyErr_Clear();
+    return py::reinterpret_borrow<py::object>(nothing);
+  }
+  return py::int_(length);
+}
+
+py::object value_(const JSONPathNodeList& nodes, py::handle nothing) {
+  if (nodes.size() == 1) {
+    return nodes[0].value;
+  }
+  return py::reinterpret_borrow<py::object>(nothing);
+}
+
+}  // namespace libjsonpath
@@ -2,23 +2,31 @@
 #include <pybind11/stl.h>
 #include <pybind11/stl_bind.h>
 
+#include <cstddef>
+#include <string>
 #include <string_view>
 #include <unordered_map>
 #include <variant>
 #include <vector>
 
 #include "libjsonpath/exceptions.hpp"
+#include "libjsonpath/frozen.hpp"
+#include "libjsonpath/functions.hpp"
 #include "libjsonpath/jsonpath.hpp"
 #include "libjsonpath/lex.hpp"
+#include "libjsonpath/lru_cache.hpp"
 #include "libjsonpath/node.hpp"
 #include "libjsonpath/parse.hpp"
 #include "libjsonpath/path.hpp"
+#include "libjsonpath/regex.hpp"
 #include "libjsonpath/selectors.hpp"
 #include "libjsonpath/tokens.hpp"
 #include "libjsonpath/utils.hpp"
 
 namespace py = pybind11;
 
+using namespace std::string_literals;
+
 PYBIND11_MAKE_OPAQUE(std::vector<libjsonpath::JSONPathNode>);
 PYBIND11_MAKE_OPAQUE(
     std::unordered_map<std::string, libjsonpath::FunctionExtensionTypes>);
@@ -95,7 +103,8 @@ PYBIND11_MODULE(_libjsonpath, m) {
 
   py::class_<libjsonpath::Lexer>(m, "Lexer")
       .def(py::init<std::string_view>())
-      .def("run", &libjsonpath::Lexer::run)
+      .def("run", &libjsonpath::Lexer::run,
+           py::call_guard<py::gil_scoped_release>())
       .def("tokens", &libjsonpath::Lexer::tokens);
 
   py::class_<libjsonpath::Parser>(m, "Parser")
@@ -106,12 +115,14 @@ PYBIND11_MODULE(_libjsonpath, m) {
            py::overload_cast<const libjsonpath::Tokens&>(
                &libjsonpath::Parser::parse, py::const_),
            "Parse a JSONPath from a sequence of tokens",
-           py::return_value_policy::move)
+           py::return_value_policy::move,
+           py::call_guard<py::gil_scoped_release>())
 
       .def("parse",
            py::overload_cast<std::string_view>(&libjsonpath::Parser::parse,
                                                py::const_),
-           "Parse a JSONPath query string", py::return_value_policy::move);
+           "Parse a JSONPath query string", py::return_value_policy::move,
+           py::call_guard<py::gil_scoped_release>());
 
   // TODO: __str__ for all of these..
 
@@ -276,7 +287,8 @@ PYBIND11_MODULE(_libjsonpath, m) {
   py::bind_map<libjsonpath::function_extension_map>(m, "FunctionExtensionMap");
 
   m.def("parse", py::overload_cast<std::string_view>(&libjsonpath::parse),
-        "Parse a JSONPath query string", py::return_value_policy::move);
+        "Parse a JSONPath query string", py::return_value_policy::move,
+        py::call_guard<py::gil_scoped_release>());
 
   m.def(
       "parse",
@@ -284,7 +296,8 @@ PYBIND11_MODULE(_libjsonpath, m) {
           std::string_view,
           std::unordered_map<std::string, libjsonpath::FunctionExtensionTypes>>(
           &libjsonpath::parse),
-      "Parse a JSONPath query string", py::return_value_policy::move);
+      "Parse a JSONPath query string", py::return_value_policy::move,
+      py::call_guard<py::gil_scoped_release>());
 
   m.def("to_string", &libjsonpath::to_string, "JSONPath segments as a string");
   m.def("singular_query", &libjsonpath::singular_query,
@@ -292,28 +305,314 @@ PYBIND11_MODULE(_libjsonpath, m) {
 
   py::class_<libjsonpath::JSONPathNode>(m, "JSONPathNode")
       .def_readonly("value", &libjsonpath::JSONPathNode::value)
-      .def_readonly("location", &libjsonpath::JSONPathNode::location)
+      .def_property_readonly("location", &libjsonpath::JSONPathNode::location)
       .def("path", &libjsonpath::JSONPathNode::path);
 
   m.def("query_",
         py::overload_cast<const libjsonpath::segments_t&, py::object,
-                          libjsonpath::function_extension_map,
-                          libjsonpath::function_signature_map, py::object>(
-            &libjsonpath::query_),
+                          const libjsonpath::function_extension_map&,
+                          const libjsonpath::function_signature_map&,
+                          py::object>(&libjsonpath::query_),
         "Query JSON-like data", py::return_value_policy::move);
 
   m.def("query_",
         py::overload_cast<std::string_view, py::object,
-                          libjsonpath::function_extension_map,
-                          libjsonpath::function_signature_map, py::object>(
-            &libjsonpath::query_),
+                          const libjsonpath::function_extension_map&,
+                          const libjsonpath::function_signature_map&,
+                          py::object>(&libjsonpath::query_),
         "Query JSON-like data", py::return_value_policy::move);
 
+  py::class_<libjsonpath::CacheInfo>(m, "CacheInfo")
+      .def_readonly("hits", &libjsonpath::CacheInfo::hits)
+      .def_readonly("misses", &libjsonpath::CacheInfo::misses)
+      .def_readonly("evictions", &libjsonpath::CacheInfo::evictions)
+      .def_readonly("size", &libjsonpath::CacheInfo::size)
+      .def_readonly("capacity", &libjsonpath::CacheInfo::capacity)
+      .def("__repr__", [](const libjsonpath::CacheInfo& info) {
+        return "CacheInfo(hits="s + std::to_string(info.hits) +
+               ", misses="s + std::to_string(info.misses) +
+               ", evictions="s + std::to_string(info.evictions) +
+               ", size="s + std::to_string(info.size) + ", capacity="s +
+               std::to_string(info.capacity) + ")"s;
+      });
+
+  py::class_<libjsonpath::NodeIterator>(m, "NodeIterator")
+      .def("__iter__", [](py::object self) { return self; })
+      .def("__next__", [](libjsonpath::NodeIterator& it) {
+        auto node{it.next()};
+        if (!node) {
+          throw py::stop_iteration();
+        }
+        return std::move(*node);
+      });
+
+  py::class_<libjsonpath::FrozenNodeIterator>(m, "FrozenNodeIterator")
+      .def("__iter__", [](py::object self) { return self; })
+      .def("__next__", [](libjsonpath::FrozenNodeIterator& it) {
+        auto node{it.next()};
+        if (!node) {
+          throw py::stop_iteration();
+        }
+        return std::move(*node);
+      });
+
+  py::class_<libjsonpath::StreamIterator>(m, "StreamIterator")
+      .def("__iter__", [](py::object self) { return self; })
+      .def("__next__", [](libjsonpath::StreamIterator& it) {
+        auto node{it.next()};
+        if (!node) {
+          throw py::stop_iteration();
+        }
+        return std::move(*node);
+      });
+
+  py::class_<libjsonpath::NDJSONIterator>(m, "NDJSONIterator")
+      .def("__iter__", [](py::object self) { return self; })
+      .def("__next__", [](libjsonpath::NDJSONIterator& it) {
+        auto line{it.next()};
+        if (!line) {
+          throw py::stop_iteration();
+        }
+        return std::move(*line);
+      });
+
+  py::class_<libjsonpath::FrozenDocument>(m, "FrozenDocument")
+      .def(py::init<py::handle>(), py::arg("data"))
+      .def_static("from_json", &libjsonpath::FrozenDocument::from_buffer,
+                  py::arg("data"),
+                  "Parse JSON from a bytes-like object into a FrozenDocument. "
+                  "Unlike json.loads, a \\u escape of a lone surrogate, like "
+                  "\"\\ud800\", raises a ValueError")
+      .def(
+          "to_python",
+          [](const libjsonpath::FrozenDocument& doc) {
+            return doc.to_python();
+          },
+          "Return a new Python object equal to the frozen document")
+      .def("__len__", &libjsonpath::FrozenDocument::size);
+
+  py::class_<libjsonpath::QuerySet>(m, "QuerySet")
+      .def("query",
+           py::overload_cast<const libjsonpath::FrozenDocument&>(
+               &libjsonpath::QuerySet::query, py::const_),
+           "Return a node list for each query", py::return_value_policy::move)
+      .def("query",
+           py::overload_cast<py::object>(&libjsonpath::QuerySet::query,
+                                         py::const_),
+           "Return a node list for each query", py::return_value_policy::move)
+      .def("findall",
+           py::overload_cast<const libjsonpath::FrozenDocument&>(
+               &libjsonpath::QuerySet::findall, py::const_),
+           "Return a list of values for each query")
+      .def("findall",
+           py::overload_cast<py::object>(&libjsonpath::QuerySet::findall,
+                                         py::const_),
+           "Return a list of values for each query")
+      .def("__len__", &libjsonpath::QuerySet::size);
+
+  py::class_<libjsonpath::Path_>(m, "Path_")
+      .def("query",
+           py::overload_cast<const libjsonpath::FrozenDocument&,
+                             std::optional<std::size_t>>(
+               &libjsonpath::Path_::query, py::const_),
+           py::arg("data"), py::arg("limit") = py::none(),
+           py::return_value_policy::move)
+      .def("query",
+           py::overload_cast<py::object, std::optional<std::size_t>>(
+               &libjsonpath::Path_::query, py::const_),
+           py::arg("data"), py::arg("limit") = py::none(),
+           py::return_value_policy::move)
+      .def("query_bytes", &libjsonpath::Path_::query_bytes,
+           "Return nodes matched by this query in JSON encoded bytes",
+           py::arg("data"), py::arg("limit") = py::none(),
+           py::return_value_policy::move)
+      .def("findall_bytes", &libjsonpath::Path_::findall_bytes,
+           "Return values matched by this query in JSON encoded bytes")
+      .def("query_many", &libjsonpath::Path_::query_many,
+           "Return a node list for each document in an iterable",
+           py::return_value_policy::move)
+      .def("findall_many", &libjsonpath::Path_::findall_many,
+           "Return a list of values for each document in an iterable")
+      .def("exists",
+           py::overload_cast<const libjsonpath::FrozenDocument&>(
+               &libjsonpath::Path_::exists, py::const_),
+           "Return True if this query matches at least one node")
+      .def("exists",
+           py::overload_cast<py::object>(&libjsonpath::Path_::exists,
+                                         py::const_),
+           "Return True if this query matches at least one node")
+      .def("first",
+           py::overload_cast<const libjsonpath::FrozenDocument&>(
+               &libjsonpath::Path_::first, py::const_),
+           "Return the first node matched by this query, or None",
+           py::return_value_policy::move)
+      .def("first",
+           py::overload_cast<py::object>(&libjsonpath::Path_::first,
+                                         py::const_),
+           "Return the first node matched by this query, or None",
+           py::return_value_policy::move)
+      .def("count",
+           py::overload_cast<const libjsonpath::FrozenDocument&>(
+               &libjsonpath::Path_::count, py::const_),
+           "Return the number of nodes matched by this query")
+      .def("count",
+           py::overload_cast<py::object>(&libjsonpath::Path_::count,
+                                         py::const_),
+           "Return the number of nodes matched by this query")
+      .def("iter",
+           py::overload_cast<const libjsonpath::FrozenDocument&>(
+               &libjsonpath::Path_::iter, py::const_),
+           "Return an iterator over nodes matched by this query",
+           py::keep_alive<0, 2>())
+      .def("iter",
+           py::overload_cast<py::object>(&libjsonpath::Path_::iter,
+                                         py::const_),
+           "Return an iterator over nodes matched by this query")
+      .def("stream", &libjsonpath::Path_::stream,
+           "Return an iterator over nodes matched by this query in JSON read "
+           "from a binary file",
+           py::arg("file"),
+           py::arg("chunk_size") = libjsonpath::DEFAULT_CHUNK_SIZE)
+      .def("query_ndjson", &libjsonpath::Path_::query_ndjson,
+           "Return an iterator over matches in each line of newline "
+           "delimited JSON, evaluated in parallel",
+           py::arg("data"), py::arg("threads") = 0,
+           py::arg("chunk_size") = libjsonpath::DEFAULT_NDJSON_CHUNK_SIZE,
+           py::arg("ordered") = true, py::arg("as_json") = false)
+      .def("findall",
+           py::overload_cast<const libjsonpath::FrozenDocument&>(
+               &libjsonpath::Path_::findall, py::const_),
+           "Return values matched by this query")
+      .def("findall",
+           py::overload_cast<py::object>(&libjsonpath::Path_::findall,
+                                         py::const_),
+           "Return values matched by this query")
+      .def_property_readonly("segments", &libjsonpath::Path_::segments)
+      .def_property_readonly("path", &libjsonpath::Path_::path);
+
+  py::class_<libjsonpath::CompileOptions>(m, "CompileOptions")
+      .def(py::init<>())
+      .def_readwrite("reorder_logical_operands",
+                     &libjsonpath::CompileOptions::reorder_logical_operands)
+      .def_readwrite("fold_constants",
+                     &libjsonpath::CompileOptions::fold_constants);
+
+  py::enum_<libjsonpath::NativeFunction>(m, "NativeFunction")
+      .value("count", libjsonpath::NativeFunction::count)
+      .value("length", libjsonpath::NativeFunction::length)
+      .value("value", libjsonpath::NativeFunction::value)
+      .value("match", libjsonpath::NativeFunction::match)
+      .value("search", libjsonpath::NativeFunction::search);
+
   py::class_<libjsonpath::Env_>(m, "Env_")
       .def(py::init<libjsonpath::function_extension_map,
-                    libjsonpath::function_signature_map, py::object>())
-      .def("query", &libjsonpath::Env_::query, py::return_value_policy::move)
+                    libjsonpath::function_signature_map, py::object,
+                    libjsonpath::native_function_map, std::size_t,
+                    libjsonpath::CompileOptions, std::size_t>(),
+           py::arg("functions"), py::arg("signatures"), py::arg("nothing"),
+           py::arg("native_functions") = libjsonpath::native_function_map{},
+           py::arg("cache_size") = libjsonpath::DEFAULT_CACHE_SIZE,
+           py::arg("options") = libjsonpath::CompileOptions{},
+           py::arg("regex_cache_size") = libjsonpath::DEFAULT_REGEX_CACHE_SIZE)
+      .def("query",
+           py::overload_cast<std::string_view,
+                             const libjsonpath::FrozenDocument&,
+                             std::optional<std::size_t>>(
+               &libjsonpath::Env_::query),
+           py::arg("path"), py::arg("data"), py::arg("limit") = py::none(),
+           py::return_value_policy::move)
+      .def("query",
+           py::overload_cast<std::string_view, py::object,
+                             std::optional<std::size_t>>(
+               &libjsonpath::Env_::query),
+           py::arg("path"), py::arg("data"), py::arg("limit") = py::none(),
+           py::return_value_policy::move)
+      .def("query_bytes", &libjsonpath::Env_::query_bytes,
+           "Return nodes matched by a JSONPath query in JSON encoded bytes",
+           py::arg("path"), py::arg("data"), py::arg("limit") = py::none(),
+           py::return_value_policy::move)
+      .def("findall_bytes", &libjsonpath::Env_::findall_bytes,
+           "Return values matched by a JSONPath query in JSON encoded bytes")
+      .def("query_many", &libjsonpath::Env_::query_many,
+           "Return a node list for each document in an iterable",
+           py::return_value_policy::move)
+      .def("findall_many", &libjsonpath::Env_::findall_many,
+           "Return a list of values for each document in an iterable")
+      .def("exists",
+           py::overload_cast<std::string_view,
+                             const libjsonpath::FrozenDocument&>(
+               &libjsonpath::Env_::exists),
+           "Return True if a JSONPath query matches at least one node")
+      .def("exists",
+           py::overload_cast<std::string_view, py::object>(
+               &libjsonpath::Env_::exists),
+           "Return True if a JSONPath query matches at least one node")
+      .def("first",
+           py::overload_cast<std::string_view,
+                             const libjsonpath::FrozenDocument&>(
+               &libjsonpath::Env_::first),
+           "Return the first node matched by a JSONPath query, or None",
+           py::return_value_policy::move)
+      .def("first",
+           py::overload_cast<std::string_view, py::object>(
+               &libjsonpath::Env_::first),
+           "Return the first node matched by a JSONPath query, or None",
+           py::return_value_policy::move)
+      .def("count",
+           py::overload_cast<std::string_view,
+                             const libjsonpath::FrozenDocument&>(
+               &libjsonpath::Env_::count),
+           "Return the number of nodes matched by a JSONPath query")
+      .def("count",
+           py::overload_cast<std::string_view, py::object>(
+               &libjsonpath::Env_::count),
+           "Return the number of nodes matched by a JSONPath query")
+      .def("iter",
+           py::overload_cast<std::string_view,
+                             const libjsonpath::FrozenDocument&>(
+               &libjsonpath::Env_::iter),
+           "Return an iterator over nodes matched by a JSONPath query",
+           py::keep_alive<0, 3>())
+      .def("iter",
+           py::overload_cast<std::string_view, py::object>(
+               &libjsonpath::Env_::iter),
+           "Return an iterator over nodes matched by a JSONPath query")
+      .def("stream", &libjsonpath::Env_::stream,
+           "Return an iterator over nodes matched by a JSONPath query in JSON "
+           "read from a binary file",
+           py::arg("path"), py::arg("file"),
+           py::arg("chunk_size") = libjsonpath::DEFAULT_CHUNK_SIZE)
+      .def("query_ndjson", &libjsonpath::Env_::query_ndjson,
+           "Return an iterator over matches of a JSONPath query in each line "
+           "of newline delimited JSON, evaluated in parallel",
+           py::arg("path"), py::arg("data"), py::arg("threads") = 0,
+           py::arg("chunk_size") = libjsonpath::DEFAULT_NDJSON_CHUNK_SIZE,
+           py::arg("ordered") = true, py::arg("as_json") = false)
+      .def("query_set", &libjsonpath::Env_::query_set,
+           "Compile JSONPath queries to be evaluated together",
+           py::return_value_policy::move)
+      .def("findall",
+           py::overload_cast<std::string_view,
+                             const libjsonpath::FrozenDocument&>(
+               &libjsonpath::Env_::findall),
+           "Return values matched by a JSONPath query")
+      .def("findall",
+           py::overload_cast<std::string_view, py::object>(
+               &libjsonpath::Env_::findall),
+           "Return values matched by a JSONPath query")
       .def("from_segments", &libjsonpath::Env_::from_segments,
            py::return_value_policy::move)
-      .def("parse", &libjsonpath::Env_::parse, py::return_value_policy::move);
+      .def("parse", &libjsonpath::Env_::parse, py::return_value_policy::move,
+           py::call_guard<py::gil_scoped_release>())
+      .def("compile", &libjsonpath::Env_::compile,
+           "Compile a JSONPath query bound to this environment",
+           py::return_value_policy::move)
+      .def("cache_info", &libjsonpath::Env_::cache_info,
+           "Return query cache statistics")
+      .def("cache_clear", &libjsonpath::Env_::cache_clear,
+           "Remove all entries from the query cache")
+      .def("regex_cache_info", &libjsonpath::Env_::regex_cache_info,
+           "Return regular expression cache statistics")
+      .def("regex_cache_clear", &libjsonpath::Env_::regex_cache_clear,
+           "Remove all entries from the regular expression cache");
 }
@@ -0,0 +1,94 @@
+#include <string_view>  // std::string_view
+#include <variant>      // std::visit
+
+#include "libjsonpath/names.hpp"
+#include "libjsonpath/selectors.hpp"
+
+namespace py = pybind11;
+
+namespace libjsonpath {
+
+py::object name_key(std::string_view name) {
+  auto key{PyUnicode_DecodeUTF8(name.data(), name.size(), nullptr)};
+  if (!key) {
+    throw py::error_already_set();
+  }
+  PyUnicode_InternInPlace(&key);
+  auto rv{py::reinterpret_steal<py::object>(key)};
+  if (PyObject_Hash(rv.ptr()) == -1) {
+    throw py::error_already_set();
+  }
+  return rv;
+}
+
+void collect_name_keys(const segments_t& segments, name_key_map& keys);
+
+class NameKeyVisitor {
+private:
+  name_key_map& m_keys;
+
+public:
+  explicit NameKeyVisitor(name_key_map& keys) : m_keys{keys} {}
+
+  void operator()(const NullLiteral&) const {}
+  void operator()(const BooleanLiteral&) const {}
+  void operator()(const IntegerLiteral&) const {}
+  void operator()(const FloatLiteral&) const {}
+  void operator()(const StringLiteral&) const {}
+
+  void operator()(const Box<LogicalNotExpression>& expression) const {
+    std::visit(*this, expression->right);
+  }
+
+  void operator()(const Box<InfixExpression>& expression) const {
+    std::visit(*this, expression->left);
+    std::visit(*this, expression->right);
+  }
+
+  void operator()(const Box<RelativeQuery>& expression) const {
+    collect_name_keys(expression->query, m_keys);
+  }
+
+  void operator()(const Box<RootQuery>& expression) const {
+    collect_name_keys(expression->query, m_keys);
+  }
+
+  void operator()(const Box<FunctionCall>& expression) const {
+    for (const auto& arg : expression->args) {
+      std::visit(*this, arg);
+    }
+  }
+
+  void operator()(const NameSelector& selector) const {
+    m_keys.emplace(&selector, name_key(selector.name));
+  }
+
+  void operator()(const IndexSelector&) const {}
+  void operator()(const WildSelector&) const {}
+  void operator()(const SliceSelector&) const {}
+
+  void operator()(const Box<FilterSelector>& selector) const {
+    std::visit(*this, selector->expression);
+  }
+};
+
+void collect_name_keys(const segments_t& segments, name_key_map& keys) {
+  NameKeyVisitor visitor{keys};
+  for (const auto& segment : segments) {
+    std::visit(
+        [&](const auto& segment_) {
+          for (const auto& selector : segment_.selectors) {
+            std::visit(visitor, selector);
+          }
+        },
+        segment);
+  }
+}
+
+name_key_map compile_name_keys(const segments_t& segments) {
+  name_key_map keys{};
+  collect_name_keys(segments, keys);
+  return keys;
+}
+
+}  // namespace libjsonpath
@@ -0,0 +1,337 @@
+#include <algorithm>           // std::count std::max std::min
+#include <condition_variable>  // std::condition_variable
+#include <cstddef>             // std::size_t
+#include <cstdint>             // std::uint32_t
+#include <cstring>             // std::memchr
+#include <exception>           // std::exception_ptr
+#include <limits>              // std::numeric_limits
+#include <map>                 // std::map
+#include <mutex>               // std::mutex std::unique_lock
+#include <optional>            // std::optional
+#include <string>              // std::string std::to_string
+#include <string_view>         // std::string_view
+#include <thread>              // std::thread
+#include <utility>             // std::move std::pair
+#include <vector>              // std::vector
+
+#include "libjsonpath/frozen.hpp"
+#include "libjsonpath/path.hpp"
+
+namespace py = pybind11;
+
+namespace libjsonpath {
+
+using namespace std::string_literals;
+
+namespace {
+
+// A run of whole lines, numbered in the order they appear in the data.
+struct Chunk {
+  std::size_t index;
+  const char* begin;
+  const char* end;
+  std::size_t first_line;
+};
+
+// Matches from one line. Matched nodes stay in the line's document until
+// the main thread converts them to Python objects, unless they have
+// already been serialized to JSON by the worker.
+struct LineResult {
+  std::size_t line;
+  std::optional<FrozenDocument> doc;
+  std::vector<std::uint32_t> nodes;
+  std::vector<std::string> json;
+};
+
+struct ChunkResult {
+  std::vector<LineResult> lines;
+  std::exception_ptr error;
+};
+
+bool is_blank(std::string_view line) {
+  for (auto c : line) {
+    if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+struct NDJSONIterator::State {
+  State(std::shared_ptr<const EvaluationContext> context_,
+        std::shared_ptr<const ParsedQuery> query_, py::buffer data,
+        std::size_t threads, std::size_t chunk_size_, bool ordered_,
+        bool as_json_)
+      : context{std::move(context_)},
+        query{std::move(query_)},
+        info{data.request()},
+        chunk_size{std::max<std::size_t>(chunk_size_, 1)},
+        ordered{ordered_},
+        as_json{as_json_} {
+    if (info.ndim != 1 || info.strides[0] != info.itemsize) {
+      throw py::type_error("expected a contiguous bytes-like object");
+    }
+
+    begin = static_cast<const char*>(info.ptr);
+    end = begin + info.size * info.itemsize;
+    split = begin;
+
+    if (threads == 0) {
+      threads = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+
+    // Don't let workers run too far ahead of the consumer, so memory use is
+    // bounded by a few chunks per thread.
+    max_pending = threads * 4;
+
+    // If a thread can't be started, the ones that were must be joined
+    // before the exception leaves the constructor, or their destructors
+    // would terminate the process.
+    try {
+      workers.reserve(threads);
+      for (std::size_t i{0}; i < threads; i++) {
+        workers.emplace_back([this] { work(); });
+      }
+    } catch (...) {
+      stop();
+      throw;
+    }
+  }
+
+  ~State() { stop(); }
+
+  // Tell workers to stop and wait for them to finish. The GIL must be held.
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock{mutex};
+      stopping = true;
+    }
+    work_ready.notify_all();
+
+    // Workers might be waiting for the GIL to run a regular expression.
+    py::gil_scoped_release release{};
+    for (auto& worker : workers) {
+      worker.join();
+    }
+  }
+
+  std::shared_ptr<const EvaluationContext> context;
+  std::shared_ptr<const ParsedQuery> query;
+  py::buffer_info info;
+  std::size_t chunk_size;
+  bool ordered;
+  bool as_json;
+
+  const char* begin{nullptr};
+  const char* end{nullptr};
+
+  std::mutex mutex{};
+  std::condition_variable work_ready{};
+  std::condition_variable result_ready{};
+  std::vector<std::thread> workers{};
+  std::size_t max_pending{0};
+  bool stopping{false};
+
+  // Where the next chunk starts, its index and the number of its first line.
+  // Guarded by _mutex_.
+  const char* split{nullptr};
+  std::size_t chunks{0};
+  std::size_t lines{0};
+
+  // Finished chunks waiting to be consumed, keyed by chunk index, and the
+  // number of chunks consumed so far. Guarded by _mutex_.
+  std::map<std::size_t, ChunkResult> results{};
+  std::size_t consumed{0};
+
+  // Lines from the chunk being consumed by next().
+  std::vector<LineResult> current{};
+  std::size_t current_pos{0};
+
+  bool done() const { return split == end && consumed == chunks; }
+
+  // Return the next chunk of whole lines. _mutex_ must be held.
+  Chunk next_chunk() {
+    auto chunk_begin{split};
+    auto chunk_end{chunk_begin + std::min<std::size_t>(
+                                     chunk_size, end - chunk_begin)};
+    if (chunk_end < end) {
+      auto newline{static_cast<const char*>(
+          std::memchr(chunk_end - 1, '\n', end - chunk_end + 1))};
+      chunk_end = newline ? newline + 1 : end;
+    }
+
+    Chunk chunk{chunks++, chunk_begin, chunk_end, lines};
+    lines += std::count(chunk_begin, chunk_end, '\n');
+    split = chunk_end;
+    return chunk;
+  }
+
+  void work() {
+    for (;;) {
+      Chunk chunk{};
+      {
+        std::unique_lock<std::mutex> lock{mutex};
+        work_ready.wait(lock, [this] {
+          return stopping || split == end || chunks - consumed < max_pending;
+        });
+
+        if (stopping || split == end) {
+          return;
+        }
+        chunk = next_chunk();
+      }
+
+      ChunkResult result{};
+      try {
+        result.lines = query_chunk(chunk);
+      } catch (...) {
+        result.error = std::current_exception();
+      }
+
+      {
+        std::lock_guard<std::mutex> lock{mutex};
+        results.emplace(chunk.index, std::move(result));
+      }
+      result_ready.notify_all();
+    }
+  }
+
+  std::vector<LineResult> query_chunk(const Chunk& chunk) const {
+    std::vector<LineResult> rv{};
+    auto line{chunk.first_line};
+
+    for (auto pos{chunk.begin}; pos < chunk.end; line++) {
+      auto newline{static_cast<const char*>(
+          std::memchr(pos, '\n', chunk.end - pos))};
+      auto line_end{newline ? newline : chunk.end};
+      std::string_view text{pos, static_cast<std::size_t>(line_end - pos)};
+      pos = line_end + 1;
+
+      if (is_blank(text)) {
+        continue;
+      }
+
+      std::optional<FrozenDocument> doc{};
+      try {
+        doc.emplace(FrozenDocument::from_json(text));
+      } catch (const py::value_error& err) {
+        throw py::value_error("line "s + std::to_string(line) + ": "s +
+                              err.what());
+      }
+
+      auto nodes{resolve_frozen_unlocked(
+          *doc, *context, *query, query->segments.begin(),
+          std::numeric_limits<std::size_t>::max())};
+      if (!nodes) {
+        throw py::type_error(
+            "can't query NDJSON with a function extension implemented in "
+            "Python");
+      }
+
+      if (nodes->empty()) {
+        continue;
+      }
+
+      LineResult result{line, std::nullopt, {}, {}};
+      if (as_json) {
+        for (auto index : *nodes) {
+          result.json.push_back(doc->to_json(index));
+        }
+      } else {
+        result.doc = std::move(doc);
+        result.nodes = std::move(*nodes);
+      }
+      rv.push_back(std::move(result));
+    }
+
+    return rv;
+  }
+
+  // Wait for the next chunk to be consumed and make it current. Returns
+  // false when there are no more chunks.
+  bool next_result() {
+    ChunkResult result{};
+    {
+      py::gil_scoped_release release{};
+      std::unique_lock<std::mutex> lock{mutex};
+      result_ready.wait(lock, [this] {
+        return done() || (ordered ? results.count(consumed) > 0
+                                  : !results.empty());
+      });
+
+      if (done()) {
+        return false;
+      }
+
+      auto it{ordered ? results.find(consumed) : results.begin()};
+      result = std::move(it->second);
+      results.erase(it);
+      consumed++;
+    }
+    work_ready.notify_all();
+
+    if (result.error) {
+      std::rethrow_exception(result.error);
+    }
+
+    current = std::move(result.lines);
+    current_pos = 0;
+    return true;
+  }
+};
+
+NDJSONIterator::NDJSONIterator(std::shared_ptr<const EvaluationContext> context,
+                               std::shared_ptr<const ParsedQuery> query,
+                               py::buffer data, std::size_t threads,
+                               std::size_t chunk_size, bool ordered,
+                               bool as_json)
+    : m_state{std::make_unique<State>(std::move(context), std::move(query),
+                                      std::move(data), threads, chunk_size,
+                                      ordered, as_json)} {}
+
+NDJSONIterator::NDJSONIterator(NDJSONIterator&& other) noexcept = default;
+
+NDJSONIterator::~NDJSONIterator() = default;
+
+std::optional<std::pair<std::size_t, py::list>> NDJSONIterator::next() {
+  auto& state{*m_state};
+  while (state.current_pos == state.current.size()) {
+    if (!state.next_result()) {
+      return std::nullopt;
+    }
+  }
+
+  auto& result{state.current[state.current_pos++]};
+  py::list values{};
+  if (state.as_json) {
+    for (const auto& json : result.json) {
+      values.append(py::bytes(json));
+    }
+  } else {
+    for (auto index : result.nodes) {
+      values.append(result.doc->to_python(index));
+    }
+  }
+
+  // Release the line's document as soon as its values have been built.
+  result.doc.reset();
+  return std::make_pair(result.line, std::move(values));
+}
+
+NDJSONIterator Path_::query_ndjson(py::buffer data, std::size_t threads,
+                                   std::size_t chunk_size, bool ordered,
+                                   bool as_json) const {
+  return NDJSONIterator{m_context, m_query, std::move(data), threads,
+                        chunk_size, ordered, as_json};
+}
+
+NDJSONIterator Env_::query_ndjson(std::string_view path, py::buffer data,
+                                  std::size_t threads, std::size_t chunk_size,
+                                  bool ordered, bool as_json) {
+  return compile(path).query_ndjson(std::move(data), threads, chunk_size,
+                                    ordered, as_json);
+}
+
+}  // namespace libjsonpath
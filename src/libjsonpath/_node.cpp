@@ -1,3 +1,6 @@
+#include <algorithm>  // std::reverse
+#include <utility>    // std::move
+
 #include "libjsonpath/node.hpp"
 
 namespace py = pybind11;
@@ -16,13 +19,57 @@ struct LocationVisitor {
   }
 };
 
-JSONPathNode::JSONPathNode(py::object& value_, location_t location_)
-    : value{value_}, location{location_} {}
+struct LocationElementVisitor {
+  std::variant<size_t, std::string> operator()(const size_t& index) const {
+    return index;
+  }
+
+  std::variant<size_t, std::string> operator()(const py::object& key) const {
+    return std::string(py::str(key));
+  }
+};
+
+LocationLink::LocationLink(location_link_t parent_,
+                           std::variant<size_t, py::object> element_)
+    : parent{std::move(parent_)}, element{std::move(element_)} {}
+
+LocationLink::~LocationLink() {
+  auto link{std::move(parent)};
+  while (link && link.use_count() == 1) {
+    // Links are never created const, so taking the parent of a link we hold
+    // the only reference to is safe. The link is then destroyed without a
+    // parent to release.
+    auto next{std::move(const_cast<LocationLink&>(*link).parent)};
+    link = std::move(next);
+  }
+}
+
+location_link_t extend_location(const location_link_t& parent, size_t index) {
+  return std::make_shared<LocationLink>(parent, index);
+}
+
+location_link_t extend_location(const location_link_t& parent,
+                                py::object key) {
+  return std::make_shared<LocationLink>(parent, std::move(key));
+}
+
+JSONPathNode::JSONPathNode(py::object value_, location_link_t link_)
+    : value{std::move(value_)}, link{std::move(link_)} {}
+
+location_t JSONPathNode::location() const {
+  LocationElementVisitor visitor{};
+  location_t rv{};
+  for (auto step = link.get(); step; step = step->parent.get()) {
+    rv.push_back(std::visit(visitor, step->element));
+  }
+  std::reverse(rv.begin(), rv.end());
+  return rv;
+}
 
-std::string JSONPathNode::path() {
+std::string JSONPathNode::path() const {
   LocationVisitor visitor{};
   auto rv = "$"s;
-  for (auto item : location) {
+  for (const auto& item : location()) {
     rv.push_back('[');
     rv.append(std::visit(visitor, item));
     rv.push_back(']');
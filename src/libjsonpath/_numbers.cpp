@@ -0,0 +1,55 @@
+#include <cmath>     // std::isnan
+#include <cstdint>   // std::int64_t
+#include <limits>    // std::numeric_limits
+#include <optional>  // std::optional
+
+#include "libjsonpath/numbers.hpp"
+
+namespace libjsonpath {
+
+int compare_numbers(std::int64_t left, std::int64_t right) {
+  return (left > right) - (left < right);
+}
+
+std::optional<int> compare_numbers(std::int64_t left, double right) {
+  if (std::isnan(right)) {
+    return std::nullopt;
+  }
+
+  // -2^63 and 2^63 are exact doubles. Floats outside that range are larger
+  // or smaller than any int64.
+  constexpr auto limit{-static_cast<double>(
+      std::numeric_limits<std::int64_t>::min())};
+  if (right >= limit) {
+    return -1;
+  }
+  if (right < -limit) {
+    return 1;
+  }
+
+  // Otherwise compare the whole part of _right_ as an integer, then its
+  // fractional part, both of which convert exactly.
+  auto whole{static_cast<std::int64_t>(right)};
+  if (left != whole) {
+    return compare_numbers(left, whole);
+  }
+  auto fraction{right - static_cast<double>(whole)};
+  return (fraction < 0) - (fraction > 0);
+}
+
+std::optional<int> compare_numbers(double left, std::int64_t right) {
+  auto order{compare_numbers(right, left)};
+  if (!order) {
+    return std::nullopt;
+  }
+  return -*order;
+}
+
+std::optional<int> compare_numbers(double left, double right) {
+  if (std::isnan(left) || std::isnan(right)) {
+    return std::nullopt;
+  }
+  return (left > right) - (left < right);
+}
+
+}  // namespace libjsonpath
@@ -0,0 +1,498 @@
+#include <cstdint>   // std::int64_t
+#include <iterator>  // std::next
+#include <optional>  // std::optional
+#include <string>    // std::string
+#include <utility>   // std::swap std::move
+#include <variant>   // std::visit std::holds_alternative std::get_if
+#include <vector>    // std::vector
+
+#include "libjsonpath/jsonpath.hpp"
+#include "libjsonpath/numbers.hpp"
+#include "libjsonpath/optimize.hpp"
+#include "libjsonpath/selectors.hpp"
+
+namespace libjsonpath {
+
+std::size_t query_cost(const segments_t& segments);
+
+struct ExpressionCostVisitor {
+  std::size_t operator()(const NullLiteral&) const { return LITERAL_COST; }
+  std::size_t operator()(const BooleanLiteral&) const { return LITERAL_COST; }
+  std::size_t operator()(const IntegerLiteral&) const { return LITERAL_COST; }
+  std::size_t operator()(const FloatLiteral&) const { return LITERAL_COST; }
+  std::size_t operator()(const StringLiteral&) const { return LITERAL_COST; }
+
+  std::size_t operator()(const Box<LogicalNotExpression>& expression) const {
+    return std::visit(*this, expression->right);
+  }
+
+  std::size_t operator()(const Box<InfixExpression>& expression) const {
+    return std::visit(*this, expression->left) +
+           std::visit(*this, expression->right);
+  }
+
+  std::size_t operator()(const Box<RelativeQuery>& expression) const {
+    return query_cost(expression->query);
+  }
+
+  std::size_t operator()(const Box<RootQuery>& expression) const {
+    return query_cost(expression->query);
+  }
+
+  std::size_t operator()(const Box<FunctionCall>& expression) const {
+    std::size_t cost{FUNCTION_CALL_COST};
+    for (const auto& arg : expression->args) {
+      cost += std::visit(*this, arg);
+    }
+    return cost;
+  }
+};
+
+struct SelectorCostVisitor {
+  std::size_t operator()(const NameSelector&) const { return 0; }
+  std::size_t operator()(const IndexSelector&) const { return 0; }
+  std::size_t operator()(const WildSelector&) const { return 0; }
+  std::size_t operator()(const SliceSelector&) const { return 0; }
+
+  std::size_t operator()(const Box<FilterSelector>& selector) const {
+    return expression_cost(selector->expression);
+  }
+};
+
+std::size_t query_cost(const segments_t& segments) {
+  std::size_t cost{singular_query(segments) ? SINGULAR_QUERY_COST
+                                             : QUERY_COST};
+  SelectorCostVisitor visitor{};
+  for (const auto& segment : segments) {
+    if (std::holds_alternative<RecursiveSegment>(segment)) {
+      cost = DESCENDANT_QUERY_COST;
+    }
+  }
+
+  for (const auto& segment : segments) {
+    std::visit(
+        [&](const auto& segment_) {
+          for (const auto& selector : segment_.selectors) {
+            cost += std::visit(visitor, selector);
+          }
+        },
+        segment);
+  }
+  return cost;
+}
+
+std::size_t expression_cost(const expression_t& expression) {
+  return std::visit(ExpressionCostVisitor{}, expression);
+}
+
+struct ReorderVisitor {
+  void operator()(NullLiteral&) const {}
+  void operator()(BooleanLiteral&) const {}
+  void operator()(IntegerLiteral&) const {}
+  void operator()(FloatLiteral&) const {}
+  void operator()(StringLiteral&) const {}
+
+  void operator()(Box<LogicalNotExpression>& expression) const {
+    std::visit(*this, expression->right);
+  }
+
+  void operator()(Box<InfixExpression>& expression) const {
+    std::visit(*this, expression->left);
+    std::visit(*this, expression->right);
+
+    if ((expression->op == BinaryOperator::logical_and ||
+         expression->op == BinaryOperator::logical_or) &&
+        expression_cost(expression->right) <
+            expression_cost(expression->left)) {
+      std::swap(expression->left, expression->right);
+    }
+  }
+
+  void operator()(Box<RelativeQuery>& expression) const {
+    reorder_logical_operands(expression->query);
+  }
+
+  void operator()(Box<RootQuery>& expression) const {
+    reorder_logical_operands(expression->query);
+  }
+
+  void operator()(Box<FunctionCall>& expression) const {
+    for (auto& arg : expression->args) {
+      std::visit(*this, arg);
+    }
+  }
+};
+
+struct SelectorReorderVisitor {
+  void operator()(NameSelector&) const {}
+  void operator()(IndexSelector&) const {}
+  void operator()(WildSelector&) const {}
+  void operator()(SliceSelector&) const {}
+
+  void operator()(Box<FilterSelector>& selector) const {
+    std::visit(ReorderVisitor{}, selector->expression);
+  }
+};
+
+void reorder_logical_operands(segments_t& segments) {
+  SelectorReorderVisitor visitor{};
+  for (auto& segment : segments) {
+    std::visit(
+        [&](auto& segment_) {
+          for (auto& selector : segment_.selectors) {
+            std::visit(visitor, selector);
+          }
+        },
+        segment);
+  }
+}
+
+// The value of a literal as seen by filter comparisons, which follow
+// Python's rules. Booleans are numbers, equal to zero or one.
+struct LiteralValue {
+  enum class Kind { null, boolean, integer, real, string } kind;
+  std::int64_t integer{0};
+  double real{0};
+  const std::string* string{nullptr};
+
+  bool number() const { return kind != Kind::null && kind != Kind::string; }
+};
+
+std::optional<LiteralValue> literal_value(const expression_t& expression) {
+  using Kind = LiteralValue::Kind;
+  if (std::holds_alternative<NullLiteral>(expression)) {
+    return LiteralValue{Kind::null};
+  }
+  if (auto literal{std::get_if<BooleanLiteral>(&expression)}) {
+    return LiteralValue{Kind::boolean, literal->value ? 1 : 0};
+  }
+  if (auto literal{std::get_if<IntegerLiteral>(&expression)}) {
+    return LiteralValue{Kind::integer, literal->value};
+  }
+  if (auto literal{std::get_if<FloatLiteral>(&expression)}) {
+    return LiteralValue{Kind::real, 0, literal->value};
+  }
+  if (auto literal{std::get_if<StringLiteral>(&expression)}) {
+    return LiteralValue{Kind::string, 0, 0, &literal->value};
+  }
+  return std::nullopt;
+}
+
+// Return -1, 0 or 1 if _left_ is less than, equal to or greater than
+// _right_, both numbers, or nothing if they are unordered.
+std::optional<int> compare_literal_numbers(const LiteralValue& left,
+                                           const LiteralValue& right) {
+  using Kind = LiteralValue::Kind;
+  if (left.kind != Kind::real && right.kind != Kind::real) {
+    return compare_numbers(left.integer, right.integer);
+  }
+  if (left.kind != Kind::real) {
+    return compare_numbers(left.integer, right.real);
+  }
+  if (right.kind != Kind::real) {
+    return compare_numbers(left.real, right.integer);
+  }
+  return compare_numbers(left.real, right.real);
+}
+
+bool literals_equal(const LiteralValue& left, const LiteralValue& right) {
+  using Kind = LiteralValue::Kind;
+  if (left.number() && right.number()) {
+    auto order{compare_literal_numbers(left, right)};
+    return order && *order == 0;
+  }
+  if (left.kind == Kind::string && right.kind == Kind::string) {
+    return *left.string == *right.string;
+  }
+  return left.kind == right.kind;
+}
+
+bool literal_less_than(const LiteralValue& left, const LiteralValue& right) {
+  using Kind = LiteralValue::Kind;
+  if (left.kind == Kind::boolean || right.kind == Kind::boolean) {
+    return false;
+  }
+  if (left.number() && right.number()) {
+    auto order{compare_literal_numbers(left, right)};
+    return order && *order < 0;
+  }
+  if (left.kind == Kind::string && right.kind == Kind::string) {
+    // Comparing UTF-8 bytes gives the same order as comparing code points.
+    return *left.string < *right.string;
+  }
+  return false;
+}
+
+// Return the result of comparing two literals, or nothing if either operand
+// is not a literal.
+std::optional<bool> compare_literals(const expression_t& left_,
+                                     BinaryOperator op,
+                                     const expression_t& right_) {
+  auto left{literal_value(left_)};
+  auto right{literal_value(right_)};
+  if (!left || !right) {
+    return std::nullopt;
+  }
+
+  auto eq{literals_equal(*left, *right)};
+  auto lt{literal_less_than(*left, *right)};
+  auto gt{literal_less_than(*right, *left)};
+
+  switch (op) {
+    case BinaryOperator::eq:
+      return eq;
+    case BinaryOperator::ne:
+      return !eq;
+    case BinaryOperator::lt:
+      return lt;
+    case BinaryOperator::gt:
+      return gt;
+    case BinaryOperator::ge:
+      return gt || eq;
+    case BinaryOperator::le:
+      return lt || eq;
+    default:
+      return std::nullopt;
+  }
+}
+
+bool selects_nothing(const segments_t& segments) {
+  for (const auto& segment : segments) {
+    if (auto segment_{std::get_if<Segment>(&segment)}) {
+      if (segment_->selectors.empty()) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+std::optional<bool> constant_condition(const expression_t& expression) {
+  if (auto literal{std::get_if<BooleanLiteral>(&expression)}) {
+    return literal->value;
+  }
+  if (literal_value(expression)) {
+    return true;
+  }
+  return std::nullopt;
+}
+
+// Return true if _expression_ always evaluates to a bool, so it can stand in
+// for a logical expression anywhere, not just as a condition.
+bool boolean_expression(const expression_t& expression) {
+  return std::holds_alternative<BooleanLiteral>(expression) ||
+         std::holds_alternative<Box<LogicalNotExpression>>(expression) ||
+         std::holds_alternative<Box<InfixExpression>>(expression);
+}
+
+bool same_expression(const expression_t& left, const expression_t& right);
+
+bool same_queries(const segments_t& left, const segments_t& right) {
+  return to_string(left) == to_string(right);
+}
+
+struct SameExpressionVisitor {
+  const expression_t& other;
+
+  bool operator()(const NullLiteral&) const {
+    return std::holds_alternative<NullLiteral>(other);
+  }
+
+  template <typename T>
+  bool same_literal(const T& expression) const {
+    auto literal{std::get_if<T>(&other)};
+    return literal && literal->value == expression.value;
+  }
+
+  bool operator()(const BooleanLiteral& expression) const {
+    return same_literal(expression);
+  }
+
+  bool operator()(const IntegerLiteral& expression) const {
+    return same_literal(expression);
+  }
+
+  bool operator()(const FloatLiteral& expression) const {
+    return same_literal(expression);
+  }
+
+  bool operator()(const StringLiteral& expression) const {
+    return same_literal(expression);
+  }
+
+  bool operator()(const Box<LogicalNotExpression>& expression) const {
+    auto not_{std::get_if<Box<LogicalNotExpression>>(&other)};
+    return not_ && same_expression(expression->right, (*not_)->right);
+  }
+
+  bool operator()(const Box<InfixExpression>& expression) const {
+    auto infix{std::get_if<Box<InfixExpression>>(&other)};
+    return infix && expression->op == (*infix)->op &&
+           same_expression(expression->left, (*infix)->left) &&
+           same_expression(expression->right, (*infix)->right);
+  }
+
+  bool operator()(const Box<RelativeQuery>& expression) const {
+    auto query{std::get_if<Box<RelativeQuery>>(&other)};
+    return query && same_queries(expression->query, (*query)->query);
+  }
+
+  bool operator()(const Box<RootQuery>& expression) const {
+    auto query{std::get_if<Box<RootQuery>>(&other)};
+    return query && same_queries(expression->query, (*query)->query);
+  }
+
+  bool operator()(const Box<FunctionCall>& expression) const {
+    auto call{std::get_if<Box<FunctionCall>>(&other)};
+    if (!call || expression->name != (*call)->name ||
+        expression->args.size() != (*call)->args.size()) {
+      return false;
+    }
+    for (std::size_t i{0}; i < expression->args.size(); i++) {
+      if (!same_expression(expression->args[i], (*call)->args[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+bool same_expression(const expression_t& left, const expression_t& right) {
+  return std::visit(SameExpressionVisitor{right}, left);
+}
+
+// Return true if _right_ is the negation of _left_, or the other way round.
+bool complementary(const expression_t& left, const expression_t& right) {
+  auto left_not{std::get_if<Box<LogicalNotExpression>>(&left)};
+  auto right_not{std::get_if<Box<LogicalNotExpression>>(&right)};
+  return (right_not && same_expression(left, (*right_not)->right)) ||
+         (left_not && same_expression((*left_not)->right, right));
+}
+
+// Replace _expression_ with a copy of _part_, one of its operands.
+void replace(expression_t& expression, const expression_t& part) {
+  expression_t replacement{part};
+  expression = std::move(replacement);
+}
+
+// Simplify _expression_. If _condition_ is true, _expression_ is only ever
+// tested for truth, so it can be replaced by anything that is true in the
+// same cases. Otherwise its value must be preserved.
+void fold(expression_t& expression, bool condition) {
+  if (auto not_{std::get_if<Box<LogicalNotExpression>>(&expression)}) {
+    auto& right{(*not_)->right};
+    fold(right, true);
+    if (auto value{constant_condition(right)}) {
+      expression = BooleanLiteral{(*not_)->token, !*value};
+    } else if (auto inner{std::get_if<Box<LogicalNotExpression>>(&right)};
+               inner && condition) {
+      // `!!x` is the same condition as `x`.
+      replace(expression, (*inner)->right);
+    }
+    return;
+  }
+
+  if (auto infix{std::get_if<Box<InfixExpression>>(&expression)}) {
+    auto& infix_{**infix};
+    auto logical_and{infix_.op == BinaryOperator::logical_and};
+    if (!logical_and && infix_.op != BinaryOperator::logical_or) {
+      fold(infix_.left, false);
+      fold(infix_.right, false);
+      if (auto value{compare_literals(infix_.left, infix_.op, infix_.right)}) {
+        expression = BooleanLiteral{infix_.token, *value};
+      }
+      return;
+    }
+
+    fold(infix_.left, true);
+    fold(infix_.right, true);
+    auto left{constant_condition(infix_.left)};
+    auto right{constant_condition(infix_.right)};
+
+    // `false && x` is false and `true || x` is true. So is `x && !x` and
+    // `x || !x`. _x_ is dropped without being evaluated, which doesn't change
+    // the result of the filter, but skips any calls to function extensions
+    // it makes.
+    if ((left && *left != logical_and) || (right && *right != logical_and) ||
+        complementary(infix_.left, infix_.right)) {
+      expression = BooleanLiteral{infix_.token, !logical_and};
+      return;
+    }
+
+    // `true && x`, `false || x`, `x && x` and `x || x` are the same
+    // condition as `x`.
+    if (left && right) {
+      expression = BooleanLiteral{infix_.token, logical_and};
+    } else if (left || right || same_expression(infix_.left, infix_.right)) {
+      const auto& operand{left ? infix_.right : infix_.left};
+      if (condition || boolean_expression(operand)) {
+        replace(expression, operand);
+      }
+    }
+    return;
+  }
+
+  if (auto query{std::get_if<Box<RelativeQuery>>(&expression)}) {
+    fold_constants((*query)->query);
+    if (condition && selects_nothing((*query)->query)) {
+      expression = BooleanLiteral{(*query)->token, false};
+    }
+    return;
+  }
+
+  if (auto query{std::get_if<Box<RootQuery>>(&expression)}) {
+    fold_constants((*query)->query);
+    if (condition && selects_nothing((*query)->query)) {
+      expression = BooleanLiteral{(*query)->token, false};
+    }
+    return;
+  }
+
+  if (auto call{std::get_if<Box<FunctionCall>>(&expression)}) {
+    for (auto& arg : (*call)->args) {
+      fold(arg, false);
+    }
+  }
+}
+
+void fold_constants(segments_t& segments) {
+  for (auto it{segments.begin()}; it != segments.end(); it++) {
+    auto& selectors{std::visit(
+        [](auto& segment) -> std::vector<selector_t>& {
+          return segment.selectors;
+        },
+        *it)};
+
+    std::vector<selector_t> folded{};
+    for (auto& selector : selectors) {
+      auto filter{std::get_if<Box<FilterSelector>>(&selector)};
+      if (!filter) {
+        folded.push_back(std::move(selector));
+        continue;
+      }
+
+      fold((*filter)->expression, true);
+      auto value{constant_condition((*filter)->expression)};
+      if (!value) {
+        folded.push_back(std::move(selector));
+      } else if (*value) {
+        // A filter that is always true selects the same nodes as a
+        // wildcard, in the same order.
+        folded.push_back(WildSelector{(*filter)->token, false});
+      }
+    }
+    selectors = std::move(folded);
+
+    // A segment with no selectors selects nothing, so later segments are
+    // never applied, and there's no need to visit descendants.
+    if (selectors.empty()) {
+      if (auto segment{std::get_if<RecursiveSegment>(&*it)}) {
+        *it = Segment{segment->token, {}};
+      }
+      segments.erase(std::next(it), segments.end());
+      return;
+    }
+  }
+}
+
+}  // namespace libjsonpath
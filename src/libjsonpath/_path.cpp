@@ -1,25 +1,31 @@
+#include <algorithm>      // std::find_if std::find_if_not
 #include <cmath>          // std::abs
 #include <cstdint>        // std::int64_t
+#include <iterator>       // std::next std::distance
 #include <limits>         // std::numeric_limits
+#include <memory>         // std::shared_ptr std::make_shared
+#include <optional>       // std::optional
 #include <string>         // std::string
 #include <unordered_map>  // std::unordered_map
 #include <variant>        // std::variant std::visit
 
+#include "libjsonpath/evaluate.hpp"
 #include "libjsonpath/exceptions.hpp"
+#include "libjsonpath/functions.hpp"
 #include "libjsonpath/jsonpath.hpp"
 #include "libjsonpath/node.hpp"
+#include "libjsonpath/optimize.hpp"
 #include "libjsonpath/path.hpp"
+#include "libjsonpath/regex.hpp"
 #include "libjsonpath/selectors.hpp"
+#include "libjsonpath/singular.hpp"
 
 namespace py = pybind11;
 
 namespace libjsonpath {
 
 using namespace std::string_literals;
-using expression_rv = std::variant<JSONPathNodeList, py::object>;
 
-// Convert negative indicies to their positive equivalents given
-// an "array" length.
 size_t normalized_index(size_t length, std::int64_t index, const Token& token) {
   if (index >= 0) {
     return static_cast<size_t>(index);
@@ -33,68 +39,270 @@ size_t normalized_index(size_t length, std::int64_t index, const Token& token) {
   return (positive_index >= 0) ? static_cast<size_t>(positive_index) : length;
 }
 
-// JSONPath expression result truthiness test.
-bool is_truthy(const expression_rv& rv) {
-  if (std::holds_alternative<JSONPathNodeList>(rv)) {
-    auto nodes = std::get<JSONPathNodeList>(rv);
-    return !nodes.empty();
+SliceBounds slice_bounds(const SliceSelector& selector, std::size_t length) {
+  std::int64_t step{selector.step.value_or(1)};
+  if (step == 0 || length == 0) {
+    return {0, step, 0};
   }
 
-  auto value{std::get<py::object>(rv)};
-  return !(py::isinstance<py::bool_>(value) && !value.cast<py::bool_>());
-}
-
-// Visit every object with _node.value_ at the root.
-void descend(const JSONPathNode& node, std::vector<JSONPathNode>& out_nodes) {
-  out_nodes.push_back(node);
-  if (py::isinstance<py::dict>(node.value)) {
-    auto obj{py::cast<py::dict>(node.value)};
-    for (auto item : obj) {
-      py::str key{item.first};
-      py::object val = py::cast<py::object>(item.second);
-      location_t location{node.location};
-      location.push_back(item.first.cast<std::string>());
-      descend({val, location}, out_nodes);
+  auto length_{static_cast<std::int64_t>(length)};
+  auto bound = [length_](std::int64_t index, std::int64_t lower,
+                         std::int64_t upper) {
+    if (index < 0) {
+      index = index < -length_ ? lower : index + length_;
     }
-  } else if (py::isinstance<py::list>(node.value)) {
-    auto obj{py::cast<py::list>(node.value)};
-    size_t index{0};
-    for (auto item : obj) {
-      py::object val = py::cast<py::object>(item);
-      location_t location{node.location};
-      location.push_back(index);
-      descend({val, location}, out_nodes);
-      index++;
+    return index < lower ? lower : (index > upper ? upper : index);
+  };
+
+  // Distances are unsigned so that the magnitude of any step fits.
+  if (step > 0) {
+    auto start{bound(selector.start.value_or(0), 0, length_)};
+    auto stop{bound(selector.stop.value_or(length_), 0, length_)};
+    if (start >= stop) {
+      return {start, step, 0};
     }
+    auto distance{static_cast<std::uint64_t>(stop - start - 1)};
+    return {start, step,
+            static_cast<std::size_t>(
+                distance / static_cast<std::uint64_t>(step) + 1)};
   }
-}
 
-// Return a list of values from a node list, or a single value if
-// the node list only has one item.
-py::object values_or_singular(const JSONPathNodeList& nodes) {
-  if (nodes.size() == 1) {
-    return nodes[0].value;
+  auto start{bound(selector.start.value_or(length_ - 1), -1, length_ - 1)};
+  auto stop{selector.stop ? bound(*selector.stop, -1, length_ - 1) : -1};
+  if (start <= stop) {
+    return {start, step, 0};
   }
+  auto distance{static_cast<std::uint64_t>(start - stop - 1)};
+  return {start, step,
+          static_cast<std::size_t>(
+              distance / (0 - static_cast<std::uint64_t>(step)) + 1)};
+}
 
-  py::list values{};
-  for (auto node : nodes) {
-    values.append(node.value);
-  }
+// Used by queries that are not evaluated by an Env_.
+const native_function_map no_native_functions{};
 
-  return values;
-}
+class FilterEvaluator;
 
+// Evaluates queries over Python objects. See evaluate.hpp.
 class QueryContext {
 public:
+  using node_t = JSONPathNode;
+  using nodes_t = JSONPathNodeList;
+  using value_t = py::object;
+  using current_t = py::object;
+  using filter_t = FilterEvaluator;
+
   QueryContext(py::object root_, const function_extension_map& functions_,
                const function_signature_map& signatures_, py::object nothing_);
+  QueryContext(py::object root_, const EvaluationContext& context,
+               const regex_map* regexes_, const filter_program_map* programs_,
+               const name_key_map* names_);
 
-  const py::object root;
+  py::object root;
   const function_extension_map& functions;
   const function_signature_map& signatures;
   const py::object nothing;
+  const native_function_map& native_functions;
+
+  // Precompiled string literal patterns for the query being evaluated, and a
+  // cache for patterns that are only known at evaluation time. Either can be
+  // null.
+  const regex_map* regexes;
+  RegexCache* regex_cache;
+
+  // Compiled filter expressions for the query being evaluated, or null if
+  // filters should be evaluated from the syntax tree.
+  const filter_program_map* programs;
+
+  // Python keys for name selectors, or null if keys should be built from
+  // each selector's name when it is applied.
+  const name_key_map* names;
+
+  // Return the Python key for _selector_.
+  py::object name_key(const NameSelector& selector) const {
+    if (names) {
+      auto it{names->find(&selector)};
+      if (it != names->end()) {
+        return it->second;
+      }
+    }
+    return py::str(selector.name);
+  }
+
+  // Results of root queries embedded in filters, keyed by the address of the
+  // query. The root value can't change while a query is being evaluated, so
+  // each root query needs to be resolved at most once.
+  mutable std::unordered_map<const RootQuery*, JSONPathNodeList>
+      root_queries{};
+
+  // Prepare to evaluate a query against a new document, keeping the memory
+  // already allocated for memoized root queries.
+  void reset(py::object root_) {
+    root = std::move(root_);
+    root_queries.clear();
+  }
+
+  bool is_array(const JSONPathNode& node) const {
+    return PyList_Check(node.value.ptr());
+  }
+
+  bool is_object(const JSONPathNode& node) const {
+    return PyDict_Check(node.value.ptr());
+  }
+
+  // Return the length of the list _node_. Lists are read directly rather
+  // than copied, so this can change if a filter function changes the list.
+  std::size_t size(const JSONPathNode& node) const {
+    return static_cast<std::size_t>(PyList_GET_SIZE(node.value.ptr()));
+  }
+
+  // Return the member of _node_ named by _selector_, if _node_ is a dict
+  // with that key.
+  template <bool keep_locations>
+  std::optional<JSONPathNode> member(const JSONPathNode& node,
+                                     const NameSelector& selector) const {
+    if (!PyDict_Check(node.value.ptr())) {
+      return std::nullopt;
+    }
+
+    auto name{name_key(selector)};
+    auto val{PyDict_GetItemWithError(node.value.ptr(), name.ptr())};
+    if (!val) {
+      if (PyErr_Occurred()) {
+        throw py::error_already_set();
+      }
+      return std::nullopt;
+    }
+    return JSONPathNode{py::reinterpret_borrow<py::object>(val),
+                        location<keep_locations>(node, std::move(name))};
+  }
+
+  // Return the item at _index_ of the list _node_, which must be less than
+  // its size.
+  template <bool keep_locations>
+  JSONPathNode item(const JSONPathNode& node, std::size_t index) const {
+    auto val{PyList_GET_ITEM(node.value.ptr(), static_cast<Py_ssize_t>(index))};
+    return {py::reinterpret_borrow<py::object>(val),
+            location<keep_locations>(node, index)};
+  }
+
+  // Return the first child of _node_ from _position_ on whose value passes
+  // _test_, and advance _position_ past it. Dicts are iterated with
+  // PyDict_Next, so for dicts _position_ is not an index.
+  template <bool keep_locations, typename Test>
+  std::optional<JSONPathNode> next_child(const JSONPathNode& node,
+                                         std::size_t& position,
+                                         Test&& test) const {
+    auto obj{node.value.ptr()};
+    if (PyDict_Check(obj)) {
+      auto pos{static_cast<Py_ssize_t>(position)};
+      PyObject* key{nullptr};
+      PyObject* item{nullptr};
+      while (PyDict_Next(obj, &pos, &key, &item)) {
+        position = static_cast<std::size_t>(pos);
+        auto val{py::reinterpret_borrow<py::object>(item)};
+        // Hold the key, in case _test_ removes it from the dict.
+        py::object key_{};
+        if constexpr (keep_locations) {
+          key_ = py::reinterpret_borrow<py::object>(key);
+        }
+        if (test(val)) {
+          return JSONPathNode{std::move(val),
+                              location<keep_locations>(node, std::move(key_))};
+        }
+      }
+      position = static_cast<std::size_t>(pos);
+    } else if (PyList_Check(obj)) {
+      while (position < static_cast<std::size_t>(PyList_GET_SIZE(obj))) {
+        auto index{position++};
+        auto val{py::reinterpret_borrow<py::object>(
+            PyList_GET_ITEM(obj, static_cast<Py_ssize_t>(index)))};
+        if (test(val)) {
+          return JSONPathNode{std::move(val),
+                              location<keep_locations>(node, index)};
+        }
+      }
+    }
+    return std::nullopt;
+  }
+
+  py::object null() const { return py::none(); }
+  py::object boolean(bool value) const { return py::bool_(value); }
+  py::object integer(std::int64_t value) const { return py::int_(value); }
+  py::object real(double value) const { return py::float_(value); }
+  py::object string(const std::string& value) const { return py::str(value); }
+
+  const py::object& value(const JSONPathNode& node) const { return node.value; }
+
+  py::object length(const py::object& value) const {
+    return length_(value, nothing);
+  }
+
+  bool is_false(const py::object& value) const {
+    return value.ptr() == Py_False;
+  }
+
+  bool is_nothing(const py::object& value) const {
+    return value.equal(nothing);
+  }
+
+  bool equal(const py::object& left, const py::object& right) const {
+    return left.equal(right);
+  }
+
+  bool less_than(const py::object& left, const py::object& right) const;
+
+  // Apply _segments_ to _current_, the current filter node.
+  JSONPathNodeList resolve(const segments_t& segments,
+                           const py::object& current) const;
+
+  // Return true if applying _segments_ to _current_ selects at least one
+  // node.
+  bool exists(const segments_t& segments, const py::object& current) const;
+
+  // Return the nodes selected by _query_, which are memoized.
+  const JSONPathNodeList* root_query(const RootQuery& query) const;
+
+  // Return the precompiled pattern for a call to match or search, if its
+  // pattern is a string literal.
+  const py::object* literal_regex(const FunctionCall& call) const {
+    if (regexes) {
+      auto it{regexes->find(&call)};
+      if (it != regexes->end()) {
+        return &it->second;
+      }
+    }
+    return nullptr;
+  }
+
+  bool regex_test(const py::object& string, const py::object& regex,
+                  bool fullmatch) const {
+    return fullmatch ? regex_fullmatch(regex, string)
+                     : regex_search(regex, string);
+  }
+
+  bool pattern_test(const py::object& string, const py::object& pattern,
+                    bool fullmatch) const;
+
+  // Call the function extension implemented in Python that is named by
+  // _call_, evaluating its arguments with _visitor_.
+  template <typename Visitor>
+  typename Visitor::rv_t call_extension(const FunctionCall& call,
+                                        const Visitor& visitor) const;
+
+private:
+  template <bool keep_locations, typename T>
+  static location_link_t location(const JSONPathNode& node, T element) {
+    if constexpr (keep_locations) {
+      return extend_location(node.link, std::move(element));
+    } else {
+      return nullptr;
+    }
+  }
 };
 
+using expression_rv = expression_result_t<QueryContext>;
+
 QueryContext::QueryContext(py::object root_,
                            const function_extension_map& functions_,
                            const function_signature_map& signatures_,
@@ -102,464 +310,817 @@ QueryContext::QueryContext(py::object root_,
     : root{root_},
       functions{functions_},
       signatures{signatures_},
-      nothing{nothing_} {}
-
-// Contextual objects a JSONPath filter will operate on.
-struct FilterContext {
-  const QueryContext& query;
-  py::object current;
-};
+      nothing{nothing_},
+      native_functions{no_native_functions},
+      regexes{nullptr},
+      regex_cache{nullptr},
+      programs{nullptr},
+      names{nullptr} {}
+
+QueryContext::QueryContext(py::object root_, const EvaluationContext& context,
+                           const regex_map* regexes_,
+                           const filter_program_map* programs_,
+                           const name_key_map* names_)
+    : root{root_},
+      functions{context.functions},
+      signatures{context.signatures},
+      nothing{context.nothing},
+      native_functions{context.native_functions},
+      regexes{regexes_},
+      regex_cache{context.regex_cache.get()},
+      programs{programs_},
+      names{names_} {}
 
-class ExpressionVisitor {
-private:
-  const FilterContext& m_context;
+// Return a list of values from a node list, or a single value if
+// the node list only has one item.
+py::object values_or_singular(const JSONPathNodeList& nodes) {
+  if (nodes.size() == 1) {
+    return nodes[0].value;
+  }
 
-public:
-  ExpressionVisitor(const FilterContext& filter_context)
-      : m_context{filter_context} {}
+  py::list values{};
+  for (auto node : nodes) {
+    values.append(node.value);
+  }
 
-  ~ExpressionVisitor() = default;
+  return values;
+}
 
-  expression_rv operator()(const NullLiteral& expression) const {
+// Return the compiled pattern for _pattern_, the second argument to match or
+// search, or None if it is not a valid pattern.
+py::object pattern_regex(const QueryContext& q_ctx, const py::object& pattern) {
+  if (!PyUnicode_Check(pattern.ptr())) {
     return py::none();
   }
 
-  expression_rv operator()(const BooleanLiteral& expression) const {
-    return py::bool_(expression.value);
+  auto pattern_{pattern.cast<std::string>()};
+  if (q_ctx.regex_cache) {
+    return q_ctx.regex_cache->get(pattern_);
   }
+  return compile_regex(pattern_);
+}
+
+bool QueryContext::pattern_test(const py::object& string,
+                                const py::object& pattern,
+                                bool fullmatch) const {
+  return regex_test(string, pattern_regex(*this, pattern), fullmatch);
+}
 
-  expression_rv operator()(const IntegerLiteral& expression) const {
-    return py::int_(expression.value);
+// Append _rv_ to the arguments for a function extension implemented in
+// Python, where the function expects an argument of type _type_.
+void append_argument(py::list& args, const expression_rv& rv,
+                     ExpressionType type, const py::object& nothing) {
+  auto nodes{node_list(rv)};
+  if (!nodes) {
+    args.append(std::get<py::object>(rv));
+  } else if (type == ExpressionType::nodes) {
+    py::list node_list = py::cast(*nodes);
+    args.append(node_list);
+  } else if (nodes->empty()) {
+    args.append(nothing);
+  } else if (nodes->size() == 1) {
+    args.append((*nodes)[0].value);
+  } else {
+    args.append(py::cast(*nodes));
   }
+}
 
-  expression_rv operator()(const FloatLiteral& expression) const {
-    return py::float_(expression.value);
+// Convert the return value of a function extension implemented in Python.
+expression_rv function_result(py::object rv, ExpressionType type) {
+  if (type == ExpressionType::nodes) {
+    // TODO: catch exception.
+    return rv.cast<JSONPathNodeList>();
   }
+  return rv;
+}
 
-  expression_rv operator()(const StringLiteral& expression) const {
-    return py::str(expression.value);
+template <typename Visitor>
+typename Visitor::rv_t QueryContext::call_extension(
+    const FunctionCall& call, const Visitor& visitor) const {
+  auto name{std::string{call.name}};
+  auto it{functions.find(name)};
+  if (it == functions.end()) {
+    throw NameError(
+        "undefined filter function '"s + std::string(call.name) + "'"s,
+        call.token);
   }
 
-  expression_rv operator()(const Box<LogicalNotExpression>& expression) const {
-    return py::bool_(!is_truthy(std::visit(*this, expression->right)));
+  py::function func = it->second;
+
+  auto sig_it{signatures.find(name)};
+  if (sig_it == signatures.end()) {
+    throw NameError("missing types for filter function '"s +
+                        std::string(call.name) + "'"s,
+                    call.token);
   }
+  const FunctionExtensionTypes& func_sig = sig_it->second;
 
-  expression_rv operator()(const Box<InfixExpression>& expression) const {
-    // Unpack single value node list.
-    expression_rv left{std::visit(*this, expression->left)};
-    if (std::holds_alternative<JSONPathNodeList>(left)) {
-      auto left_ = std::get<JSONPathNodeList>(left);
-      if (left_.size() == 1) {
-        left = left_[0].value;
-      }
-    }
+  py::list args{};
+  size_t index = 0;
 
-    // Unpack single value node list.
-    expression_rv right{std::visit(*this, expression->right)};
-    if (std::holds_alternative<JSONPathNodeList>(right)) {
-      auto right_ = std::get<JSONPathNodeList>(right);
-      if (right_.size() == 1) {
-        right = right_[0].value;
-      }
-    }
+  // Assumes the function call has already been validated and has the
+  // correct number of arguments.
+  for (const auto& arg : call.args) {
+    append_argument(args, std::visit(visitor, arg), func_sig.args[index],
+                    nothing);
+    index++;
+  }
 
-    if (expression->op == BinaryOperator::logical_and) {
-      return py::bool_(is_truthy(left) && is_truthy(right));
-    }
+  return function_result(func(*args), func_sig.res);
+}
 
-    if (expression->op == BinaryOperator::logical_or) {
-      return py::bool_(is_truthy(left) || is_truthy(right));
-    }
+bool QueryContext::less_than(const py::object& left,
+                             const py::object& right) const {
+  if (py::isinstance<py::bool_>(left) || py::isinstance<py::bool_>(right)) {
+    return false;
+  }
 
-    return py::bool_(compare(left, expression->op, right));
+  if (py::isinstance<py::str>(left) && py::isinstance<py::str>(right)) {
+    return left < right;
   }
 
-  expression_rv operator()(const Box<RelativeQuery>& expression) const {
-    return query_(expression->query, m_context.current,
-                  m_context.query.functions, m_context.query.signatures,
-                  m_context.query.nothing);
+  if (py::isinstance<py::int_>(left) && py::isinstance<py::int_>(right)) {
+    return left < right;
   }
 
-  expression_rv operator()(const Box<RootQuery>& expression) const {
-    return query_(expression->query, m_context.query.root,
-                  m_context.query.functions, m_context.query.signatures,
-                  m_context.query.nothing);
+  if (py::isinstance<py::int_>(left) && py::isinstance<py::float_>(right)) {
+    return left < right;
   }
 
-  expression_rv operator()(const Box<FunctionCall>& expression) const {
-    auto name{std::string{expression->name}};
-    auto it{m_context.query.functions.find(name)};
-    if (it == m_context.query.functions.end()) {
-      throw NameError(
-          "undefined filter function '"s + std::string(expression->name) + "'"s,
-          expression->token);
-    }
+  if (py::isinstance<py::float_>(left) && py::isinstance<py::float_>(right)) {
+    return left < right;
+  }
+
+  if (py::isinstance<py::float_>(left) && py::isinstance<py::int_>(right)) {
+    return left < right;
+  }
+
+  return false;
+}
 
-    py::function func = it->second;
+// Applies a filter selector to one node at a time, running the filter's
+// compiled program if it has one, or walking its syntax tree otherwise.
+class FilterEvaluator {
+private:
+  const QueryContext& m_query;
+  const FilterSelector& m_selector;
+  const FilterProgram* m_program{nullptr};
+  std::vector<expression_rv> m_stack{};
+
+public:
+  FilterEvaluator(const QueryContext& q_ctx, const FilterSelector& selector)
+      : m_query{q_ctx}, m_selector{selector} {
+    if (m_query.programs) {
+      auto it{m_query.programs->find(&selector)};
+      if (it != m_query.programs->end()) {
+        m_program = &it->second;
+        m_stack.reserve(m_program->max_stack);
+      }
+    }
+  }
 
-    auto sig_it{m_context.query.signatures.find(name)};
-    if (sig_it == m_context.query.signatures.end()) {
-      throw NameError("missing types for filter function '"s +
-                          std::string(expression->name) + "'"s,
-                      expression->token);
+  // Return true if _current_ passes the filter.
+  bool test(const py::object& current) {
+    if (m_program) {
+      return run(current);
     }
-    FunctionExtensionTypes func_sig = sig_it->second;
-
-    py::list args{};
-    size_t index = 0;
-
-    for (auto arg : expression->args) {
-      expression_rv arg_rv{std::visit(*this, arg)};
-      if (std::holds_alternative<JSONPathNodeList>(arg_rv)) {
-        auto nodes{std::get<JSONPathNodeList>(arg_rv)};
-        // Is the parameter expected a node list of values?
-        // Assumes the function call has already been validated and has
-        // the correct number of arguments.
-        if (func_sig.args[index] != ExpressionType::nodes) {
-          if (nodes.empty()) {
-            args.append(m_context.query.nothing);
-          } else if (nodes.size() == 1) {
-            args.append(nodes[0].value);
+
+    ExpressionVisitor<QueryContext> visitor{m_query, current};
+    return visitor.test(m_selector.expression);
+  }
+
+private:
+  bool run(const py::object& current) {
+    const auto& program{*m_program};
+    const auto& nothing{m_query.nothing};
+    m_stack.clear();
+
+    std::size_t pc{0};
+    while (pc < program.code.size()) {
+      const auto& instruction{program.code[pc++]};
+      const auto operand{instruction.operand};
+      switch (instruction.op) {
+        case Opcode::constant:
+          m_stack.emplace_back(program.constants[operand]);
+          break;
+        case Opcode::relative_query:
+          m_stack.emplace_back(
+              m_query.resolve(*program.relative_queries[operand], current));
+          break;
+        case Opcode::relative_exists:
+          m_stack.emplace_back(py::bool_(
+              m_query.exists(*program.relative_queries[operand], current)));
+          break;
+        case Opcode::singular_value: {
+          auto value{lookup(program.singular_queries[operand], current)};
+          m_stack.emplace_back(value ? std::move(value) : nothing);
+          break;
+        }
+        case Opcode::singular_exists: {
+          auto value{lookup(program.singular_queries[operand], current)};
+          m_stack.emplace_back(py::bool_(static_cast<bool>(value)));
+          break;
+        }
+        case Opcode::root_query:
+          m_stack.emplace_back(
+              m_query.root_query(*program.root_queries[operand]));
+          break;
+        case Opcode::test:
+          m_stack.back() = py::bool_(is_truthy(m_query, m_stack.back()));
+          break;
+        case Opcode::logical_not:
+          m_stack.back() = py::bool_(!is_truthy(m_query, m_stack.back()));
+          break;
+        case Opcode::jump_if_false:
+          if (is_truthy(m_query, m_stack.back())) {
+            m_stack.pop_back();
           } else {
-            args.append(py::cast(nodes));
+            pc = operand;
           }
-        } else {
-          py::list node_list = py::cast(nodes);
-          args.append(node_list);
+          break;
+        case Opcode::jump_if_true:
+          if (is_truthy(m_query, m_stack.back())) {
+            pc = operand;
+          } else {
+            m_stack.pop_back();
+          }
+          break;
+        case Opcode::compare: {
+          auto right{unpack(m_query, pop())};
+          auto left{unpack(m_query, std::move(m_stack.back()))};
+          m_stack.back() = py::bool_(compare(
+              m_query, left, static_cast<BinaryOperator>(operand), right));
+          break;
+        }
+        case Opcode::count:
+          m_stack.back() = count_(nodes_argument(m_stack.back()));
+          break;
+        case Opcode::length:
+          m_stack.back() = length_(value_of(m_query, m_stack.back()), nothing);
+          break;
+        case Opcode::value:
+          m_stack.back() = value_(nodes_argument(m_stack.back()), nothing);
+          break;
+        case Opcode::match:
+        case Opcode::search: {
+          auto pattern{pop()};
+          auto regex{operand
+                         ? std::get<py::object>(pattern)
+                         : pattern_regex(m_query, value_of(m_query, pattern))};
+          auto string{value_of(m_query, m_stack.back())};
+          m_stack.back() = py::bool_(instruction.op == Opcode::match
+                                         ? regex_fullmatch(regex, string)
+                                         : regex_search(regex, string));
+          break;
+        }
+        case Opcode::call: {
+          const auto& call{program.calls[operand]};
+          const auto& signature{call.signature};
+          auto first{m_stack.size() - signature.args.size()};
+          py::list args{};
+          for (std::size_t i{0}; i < signature.args.size(); i++) {
+            append_argument(args, m_stack[first + i], signature.args[i],
+                            nothing);
+          }
+          m_stack.erase(m_stack.begin() + first, m_stack.end());
+          m_stack.push_back(
+              function_result(call.function(*args), signature.res));
+          break;
         }
-      } else {
-        args.append(std::get<py::object>(arg_rv));
       }
-
-      index++;
     }
 
-    auto rv{func(*args)};
-    if (func_sig.res == ExpressionType::nodes) {
-      // TODO: catch exception.
-      return rv.cast<JSONPathNodeList>();
-    }
-    return rv;
+    return is_truthy(m_query, m_stack.back());
   }
 
-private:
-  bool compare(const expression_rv& left, BinaryOperator op,
-               const expression_rv& right) const {
-    switch (op) {
-      case BinaryOperator::eq:
-        return equals(left, right);
-      case BinaryOperator::ne:
-        return !equals(left, right);
-      case BinaryOperator::lt:
-        return less_than(left, right);
-      case BinaryOperator::gt:
-        return less_than(right, left);
-      case BinaryOperator::ge:
-        return less_than(right, left) || equals(left, right);
-      case BinaryOperator::le:
-        return less_than(left, right) || equals(left, right);
-      default:
-        return false;
-    }
+  expression_rv pop() {
+    expression_rv rv{std::move(m_stack.back())};
+    m_stack.pop_back();
+    return rv;
   }
+};
 
-  bool equals(const expression_rv& left_, const expression_rv& right_) const {
-    if (std::holds_alternative<JSONPathNodeList>(left_)) {
-      return node_list_equals(std::get<JSONPathNodeList>(left_), right_);
-    }
 
-    if (std::holds_alternative<JSONPathNodeList>(right_)) {
-      return node_list_equals(std::get<JSONPathNodeList>(right_), left_);
-    }
+// Selected nodes are appended to a node list, until it has _limit_ nodes.
+struct NodeListOutput {
+  static constexpr bool keeps_locations{true};
+  static constexpr std::size_t unlimited{
+      std::numeric_limits<std::size_t>::max()};
+  JSONPathNodeList& nodes;
+  std::size_t limit{unlimited};
 
-    // Both left and right are py objects.
-    py::object left{std::get<py::object>(left_)};
-    py::object right{std::get<py::object>(right_)};
-    return left.equal(right);
+  void push(JSONPathNode node) { nodes.push_back(std::move(node)); }
+
+  bool done() const { return nodes.size() >= limit; }
+};
+
+// Selected values are appended to a Python list and their locations are
+// discarded.
+struct ValueListOutput {
+  static constexpr bool keeps_locations{false};
+  py::list& values;
+
+  void push(const JSONPathNode& node) { values.append(node.value); }
+
+  bool done() const { return false; }
+};
+
+// Selection stops as soon as any node is selected.
+struct ExistsOutput {
+  static constexpr bool keeps_locations{false};
+  bool found{false};
+
+  void push(const JSONPathNode&) { found = true; }
+
+  bool done() const { return found; }
+};
+
+// Selected nodes are counted and discarded.
+struct CountOutput {
+  static constexpr bool keeps_locations{false};
+  std::size_t count{0};
+
+  void push(const JSONPathNode&) { count++; }
+
+  bool done() const { return false; }
+};
+
+
+JSONPathNodeList QueryContext::resolve(const segments_t& segments,
+                                       const py::object& current) const {
+  JSONPathNodeList nodes{};
+  NodeListOutput out{nodes};
+  resolve_node(*this, segments.begin(), segments.end(), {current, {}}, out);
+  return nodes;
+}
+
+bool QueryContext::exists(const segments_t& segments,
+                          const py::object& current) const {
+  ExistsOutput out{};
+  resolve_node(*this, segments.begin(), segments.end(), {current, {}}, out);
+  return out.found;
+}
+
+const JSONPathNodeList* QueryContext::root_query(const RootQuery& query) const {
+  auto it{root_queries.find(&query)};
+  if (it == root_queries.end()) {
+    it = root_queries.emplace(&query, resolve(query.query, root)).first;
   }
+  return &it->second;
+}
 
-  bool node_list_equals(const JSONPathNodeList& left,
-                        const expression_rv& right_) const {
-    if (std::holds_alternative<py::object>(right_)) {
-      py::object right{std::get<py::object>(right_)};
+// Apply _segments_ to _obj_, pushing selected nodes to _out_.
+template <typename Output>
+void resolve_into(const QueryContext& q_ctx, const segments_t& segments,
+                  py::object obj, Output& out) {
+  // Bootstrap with the root object and an empty location.
+  resolve_node(q_ctx, segments.begin(), segments.end(), {obj, {}}, out);
+}
 
-      // left is an empty node list and right is NOTHING.
-      if (left.empty()) {
-        return right.equal(m_context.query.nothing);
-      }
+// Apply _query_ to _obj_, pushing selected nodes to _out_. A singular query
+// is a chain of lookups, so it doesn't need a node list for each segment.
+template <typename Output>
+void resolve_query(const QueryContext& q_ctx, const ParsedQuery& query,
+                   py::object obj, Output& out) {
+  if (!query.singular) {
+    resolve_into(q_ctx, query.segments, obj, out);
+    return;
+  }
 
-      // left is a single element node list, compare the node's value to right.
-      if (left.size() == 1) {
-        return left[0].value.equal(right);
-      }
+  if (out.done()) {
+    return;
+  }
 
-      return false;
+  location_link_t link{};
+  std::size_t index{0};
+  for (const auto& step : query.singular->steps) {
+    obj = lookup_step(step, obj, index);
+    if (!obj) {
+      return;
     }
+    if constexpr (Output::keeps_locations) {
+      link = step.name ? extend_location(link, step.name)
+                       : extend_location(link, index);
+    }
+  }
+  out.push({std::move(obj), std::move(link)});
+}
+
+JSONPathNodeList query_(const segments_t& segments, py::object obj,
+                        const function_extension_map& functions,
+                        const function_signature_map& signatures,
+                        py::object nothing) {
+  QueryContext q_ctx{obj, functions, signatures, nothing};
+  return q_ctx.resolve(segments, obj);
+}
+
+JSONPathNodeList query_(std::string_view path, py::object obj,
+                        const function_extension_map& functions,
+                        const function_signature_map& signatures,
+                        py::object nothing) {
+  segments_t segments{parse(path, signatures)};
+  QueryContext q_ctx{obj, functions, signatures, nothing};
+  return q_ctx.resolve(segments, obj);
+}
 
-    // left and right are node lists.
-    JSONPathNodeList right{std::get<JSONPathNodeList>(right_)};
+JSONPathNodeList Path_::query(py::object obj,
+                              std::optional<std::size_t> limit) const {
+  QueryContext q_ctx{obj, *m_context, &m_query->regexes,
+                     &m_query->programs, &m_query->names};
+  JSONPathNodeList nodes{};
+  NodeListOutput out{nodes, limit.value_or(NodeListOutput::unlimited)};
+  resolve_query(q_ctx, *m_query, obj, out);
+  return nodes;
+}
 
-    // Are both lists are empty?
-    if (left.empty() && right.empty()) {
-      return true;
+py::list Path_::findall(py::object obj) const {
+  QueryContext q_ctx{obj, *m_context, &m_query->regexes,
+                     &m_query->programs, &m_query->names};
+  py::list values{};
+  ValueListOutput out{values};
+  resolve_query(q_ctx, *m_query, obj, out);
+  return values;
+}
+
+std::vector<JSONPathNodeList> Path_::query_many(py::iterable docs) const {
+  QueryContext q_ctx{py::none(), *m_context, &m_query->regexes,
+                     &m_query->programs, &m_query->names};
+  std::vector<JSONPathNodeList> results{};
+  for (auto doc : docs) {
+    if (py::isinstance<FrozenDocument>(doc)) {
+      results.push_back(query(doc.cast<const FrozenDocument&>()));
+      continue;
     }
+    auto obj{py::reinterpret_borrow<py::object>(doc)};
+    q_ctx.reset(obj);
+    JSONPathNodeList nodes{};
+    NodeListOutput out{nodes};
+    resolve_query(q_ctx, *m_query, obj, out);
+    results.push_back(std::move(nodes));
+  }
+  return results;
+}
 
-    // Do both lists have a single node?
-    if (left.size() == 1 && right.size() == 1) {
-      return left[0].value.equal(right[0].value);
+py::list Path_::findall_many(py::iterable docs) const {
+  QueryContext q_ctx{py::none(), *m_context, &m_query->regexes,
+                     &m_query->programs, &m_query->names};
+  py::list results{};
+  for (auto doc : docs) {
+    if (py::isinstance<FrozenDocument>(doc)) {
+      results.append(findall(doc.cast<const FrozenDocument&>()));
+      continue;
     }
+    auto obj{py::reinterpret_borrow<py::object>(doc)};
+    q_ctx.reset(obj);
+    py::list values{};
+    ValueListOutput out{values};
+    resolve_query(q_ctx, *m_query, obj, out);
+    results.append(values);
+  }
+  return results;
+}
 
-    return false;
+bool Path_::exists(py::object obj) const {
+  QueryContext q_ctx{obj, *m_context, &m_query->regexes,
+                     &m_query->programs, &m_query->names};
+  ExistsOutput out{};
+  resolve_query(q_ctx, *m_query, obj, out);
+  return out.found;
+}
+
+std::optional<JSONPathNode> Path_::first(py::object obj) const {
+  auto nodes{query(obj, 1)};
+  if (nodes.empty()) {
+    return std::nullopt;
   }
+  return std::move(nodes[0]);
+}
 
-  bool less_than(const expression_rv& left_,
-                 const expression_rv& right_) const {
-    if (std::holds_alternative<JSONPathNodeList>(left_) ||
-        std::holds_alternative<JSONPathNodeList>(right_)) {
-      return false;
-    }
+std::size_t Path_::count(py::object obj) const {
+  QueryContext q_ctx{obj, *m_context, &m_query->regexes,
+                     &m_query->programs, &m_query->names};
+  CountOutput out{};
+  resolve_query(q_ctx, *m_query, obj, out);
+  return out.count;
+}
 
-    py::object left{std::get<py::object>(left_)};
-    py::object right{std::get<py::object>(right_)};
+NodeIterator Path_::iter(py::object obj) const {
+  return NodeIterator{m_context, m_query, obj};
+}
 
-    if (py::isinstance<py::bool_>(left) || py::isinstance<py::bool_>(right)) {
-      return false;
-    }
+// A node waiting to have the segment at index _segment_ applied to it.
+// Nodes that have been through every segment are ready to be returned.
+//
+// If _descend_ is true, _node_ is an array or object whose children still
+// need the recursive segment at index _segment_ applied to them. Its
+// children are taken one at a time, starting from _position_.
+struct PendingNode {
+  JSONPathNode node;
+  std::size_t segment;
+  bool descend{false};
+  std::size_t position{0};
+};
 
-    if (py::isinstance<py::str>(left) && py::isinstance<py::str>(right)) {
-      return left < right;
-    }
+struct NodeIterator::State {
+  State(std::shared_ptr<const EvaluationContext> context_,
+        std::shared_ptr<const ParsedQuery> query_, py::object obj)
+      : context{std::move(context_)},
+        query{std::move(query_)},
+        q_ctx{obj, *context, &query->regexes, &query->programs,
+              &query->names} {
+    stack.push_back({{obj, {}}, 0});
+  }
 
-    if (py::isinstance<py::int_>(left) && py::isinstance<py::int_>(right)) {
-      return left < right;
+  std::shared_ptr<const EvaluationContext> context;
+  std::shared_ptr<const ParsedQuery> query;
+  QueryContext q_ctx;
+
+  // Pending nodes in reverse document order, so the next node to visit is
+  // at the back. Containers being descended into hold one frame each, so the
+  // stack grows with the depth of the data, not the width.
+  std::vector<PendingNode> stack{};
+
+  void push(JSONPathNodeList nodes, std::size_t segment) {
+    for (auto it{nodes.rbegin()}; it != nodes.rend(); it++) {
+      stack.push_back({std::move(*it), segment});
     }
+  }
+};
 
-    if (py::isinstance<py::int_>(left) && py::isinstance<py::float_>(right)) {
-      return left < right;
+NodeIterator::NodeIterator(std::shared_ptr<const EvaluationContext> context,
+                           std::shared_ptr<const ParsedQuery> query,
+                           py::object obj)
+    : m_state{std::make_unique<State>(std::move(context), std::move(query),
+                                      obj)} {}
+
+NodeIterator::NodeIterator(NodeIterator&& other) noexcept = default;
+
+NodeIterator::~NodeIterator() = default;
+
+std::optional<JSONPathNode> NodeIterator::next() {
+  auto& state{*m_state};
+  const auto& segments{state.query->segments};
+
+  while (!state.stack.empty()) {
+    auto& top{state.stack.back()};
+    if (top.descend) {
+      auto child{state.q_ctx.next_child<true>(
+          top.node, top.position, [](const auto&) { return true; })};
+      if (!child) {
+        state.stack.pop_back();
+        continue;
+      }
+      auto segment{top.segment};
+      state.stack.push_back({std::move(*child), segment});
+      continue;
     }
 
-    if (py::isinstance<py::float_>(left) && py::isinstance<py::float_>(right)) {
-      return left < right;
+    PendingNode pending{std::move(top)};
+    state.stack.pop_back();
+
+    if (pending.segment == segments.size()) {
+      return std::move(pending.node);
     }
 
-    if (py::isinstance<py::float_>(left) && py::isinstance<py::int_>(right)) {
-      return left < right;
+    // Select from this node only. A recursive segment is applied to each
+    // descendant when that descendant is visited, after the nodes selected
+    // from its parent.
+    const auto& segment{segments[pending.segment]};
+    if (std::holds_alternative<RecursiveSegment>(segment) &&
+        (state.q_ctx.is_array(pending.node) ||
+         state.q_ctx.is_object(pending.node))) {
+      state.stack.push_back({pending.node, pending.segment, true});
     }
 
-    return false;
+    JSONPathNodeList selected{};
+    NodeListOutput out{selected};
+    SelectorVisitor<QueryContext, NodeListOutput> visitor{state.q_ctx,
+                                                          pending.node, out};
+    std::visit(
+        [&](const auto& segment_) {
+          for (const auto& selector : segment_.selectors) {
+            std::visit(visitor, selector);
+          }
+        },
+        segment);
+    state.push(std::move(selected), pending.segment + 1);
   }
-};
 
-class SelectorVisitor {
-private:
-  const QueryContext& m_query_context;
-  const JSONPathNode& m_node;
-  std::vector<JSONPathNode>* m_out_nodes;
+  return std::nullopt;
+}
 
-public:
-  SelectorVisitor(const QueryContext& q_ctx, const JSONPathNode& node,
-                  std::vector<JSONPathNode>* out_nodes)
-      : m_query_context{q_ctx}, m_node{node}, m_out_nodes{out_nodes} {}
-
-  ~SelectorVisitor() = default;
-
-  void operator()(const NameSelector& selector) {
-    if (py::isinstance<py::dict>(m_node.value)) {
-      auto obj{py::cast<py::dict>(m_node.value)};
-      py::str name{selector.name};
-      if (obj.contains(name)) {
-        py::object val{obj[name]};
-        location_t location{m_node.location};
-        location.push_back(selector.name);
-        m_out_nodes->push_back(JSONPathNode{val, location});
+QuerySet::QuerySet(std::shared_ptr<const EvaluationContext> context,
+                   std::vector<std::shared_ptr<const ParsedQuery>> queries)
+    : m_context{std::move(context)},
+      m_queries{std::move(queries)},
+      m_trie{"", nullptr, {}, {}},
+      m_regexes{},
+      m_programs{},
+      m_names{} {
+  for (std::size_t i{0}; i < m_queries.size(); i++) {
+    SegmentTrie* node{&m_trie};
+    for (const auto& segment : m_queries[i]->segments) {
+      auto key{to_string(segments_t{segment})};
+      auto it{std::find_if(
+          node->children.begin(), node->children.end(),
+          [&key](const SegmentTrie& child) { return child.key == key; })};
+      if (it == node->children.end()) {
+        node = &node->children.emplace_back(
+            SegmentTrie{std::move(key), &segment, {}, {}});
+      } else {
+        node = &*it;
       }
     }
+    node->queries.push_back(i);
+
+    // Filters in shared segments come from whichever query added that
+    // segment to the trie, so their patterns, programs and keys are looked
+    // up in one map.
+    m_regexes.insert(m_queries[i]->regexes.begin(),
+                     m_queries[i]->regexes.end());
+    m_programs.insert(m_queries[i]->programs.begin(),
+                      m_queries[i]->programs.end());
+    m_names.insert(m_queries[i]->names.begin(), m_queries[i]->names.end());
   }
+}
 
-  void operator()(const IndexSelector& selector) {
-    if (py::isinstance<py::list>(m_node.value)) {
-      auto obj{py::cast<py::list>(m_node.value)};
-      size_t len{py::len(obj)};
-      auto index{normalized_index(len, selector.index, selector.token)};
-      if (index >= 0 && index < len) {
-        py::object val{obj[py::int_(index)]};
-        location_t location{m_node.location};
-        location.push_back(index);
-        m_out_nodes->push_back(JSONPathNode{val, location});
+// Apply the selectors of each recursive segment in _segments_ to _node_ and
+// every node below it, appending selected nodes to the matching list in
+// _out_. The data is walked once, however many segments there are.
+void descend_many(const QueryContext& q_ctx, const JSONPathNode& node,
+                  const std::vector<const SegmentTrie*>& segments,
+                  std::vector<JSONPathNodeList>& out) {
+  walk_descendants<true>(q_ctx, node, [&](const JSONPathNode& descendant) {
+    for (std::size_t i{0}; i < segments.size(); i++) {
+      NodeListOutput out_{out[i]};
+      SelectorVisitor<QueryContext, NodeListOutput> visitor{q_ctx, descendant,
+                                                            out_};
+      for (const auto& selector :
+           std::get<RecursiveSegment>(*segments[i]->segment).selectors) {
+        std::visit(visitor, selector);
       }
     }
-  }
+    return true;
+  });
+}
 
-  void operator()(const WildSelector&) {
-    if (py::isinstance<py::dict>(m_node.value)) {
-      auto obj{py::cast<py::dict>(m_node.value)};
-      for (auto item : obj) {
-        py::str key{item.first};
-        py::object val = py::cast<py::object>(item.second);
-        location_t location{m_node.location};
-        location.push_back(item.first.cast<std::string>());
-        m_out_nodes->push_back(JSONPathNode{val, location});
-      }
-    } else if (py::isinstance<py::list>(m_node.value)) {
-      auto obj{py::cast<py::list>(m_node.value)};
-      size_t index{0};
-      for (auto item : obj) {
-        py::object val = py::cast<py::object>(item);
-        location_t location{m_node.location};
-        location.push_back(index);
-        m_out_nodes->push_back(JSONPathNode{val, location});
-        index++;
-      }
+// Apply the segments below _trie_ to _nodes_, storing the nodes selected by
+// each query in _results_.
+void resolve_trie(const QueryContext& q_ctx, const SegmentTrie& trie,
+                  JSONPathNodeList nodes,
+                  std::vector<JSONPathNodeList>& results) {
+  std::vector<const SegmentTrie*> recursive{};
+  for (const auto& child : trie.children) {
+    if (std::holds_alternative<RecursiveSegment>(*child.segment)) {
+      recursive.push_back(&child);
+      continue;
     }
+
+    JSONPathNodeList selected{};
+    NodeListOutput out{selected};
+    for (const auto& node : nodes) {
+      SegmentVisitor<QueryContext, NodeListOutput> visitor{q_ctx, node, out};
+      std::visit(visitor, *child.segment);
+    }
+    resolve_trie(q_ctx, child, std::move(selected), results);
   }
 
-  void operator()(const SliceSelector& selector) {
-    if (py::isinstance<py::list>(m_node.value) && selector.step != 0) {
-      auto obj{py::cast<py::list>(m_node.value)};
-      size_t index{selector.start || 0};
-      size_t step{selector.step || 1};
-      py::slice slice{selector.start, selector.stop, selector.step};
-      for (auto item : obj[slice]) {
-        py::object val = py::cast<py::object>(item);
-        auto norm_index{normalized_index(py::len(obj), index, selector.token)};
-        location_t location{m_node.location};
-        location.push_back(norm_index);
-        m_out_nodes->push_back(JSONPathNode{val, location});
-        index += step;
-      }
+  if (!recursive.empty()) {
+    std::vector<JSONPathNodeList> selected(recursive.size());
+    for (const auto& node : nodes) {
+      descend_many(q_ctx, node, recursive, selected);
+    }
+    for (std::size_t i{0}; i < recursive.size(); i++) {
+      resolve_trie(q_ctx, *recursive[i], std::move(selected[i]), results);
     }
   }
 
-  void operator()(const Box<FilterSelector>& selector) {
-    if (py::isinstance<py::dict>(m_node.value)) {
-      auto obj{py::cast<py::dict>(m_node.value)};
-      for (auto item : obj) {
-        py::object val = py::cast<py::object>(item.second);
-        FilterContext filter_context{m_query_context, val};
-        ExpressionVisitor visitor{filter_context};
+  for (auto it{trie.queries.begin()}; it != trie.queries.end(); it++) {
+    if (std::next(it) == trie.queries.end()) {
+      results[*it] = std::move(nodes);
+    } else {
+      results[*it] = nodes;
+    }
+  }
+}
 
-        if (is_truthy(std::visit(visitor, selector->expression))) {
-          location_t location{m_node.location};
-          location.push_back(item.first.cast<std::string>());
-          m_out_nodes->push_back({val, location});
-        }
-      }
-    } else if (py::isinstance<py::list>(m_node.value)) {
-      auto obj{py::cast<py::list>(m_node.value)};
-      size_t index{0};
-      for (auto item : obj) {
-        py::object val = py::cast<py::object>(item);
-        FilterContext filter_context{m_query_context, val};
-        ExpressionVisitor visitor{filter_context};
-
-        if (is_truthy(std::visit(visitor, selector->expression))) {
-          location_t location{m_node.location};
-          location.push_back(index);
-          m_out_nodes->push_back({val, location});
-        }
+std::vector<JSONPathNodeList> QuerySet::query(py::object obj) const {
+  QueryContext q_ctx{obj, *m_context, &m_regexes, &m_programs, &m_names};
+  std::vector<JSONPathNodeList> results(m_queries.size());
+  resolve_trie(q_ctx, m_trie, {{obj, {}}}, results);
+  return results;
+}
 
-        index++;
-      }
+py::list QuerySet::findall(py::object obj) const {
+  py::list values{};
+  for (const auto& nodes : query(obj)) {
+    py::list values_{};
+    for (const auto& node : nodes) {
+      values_.append(node.value);
     }
+    values.append(values_);
   }
-};
+  return values;
+}
 
-class SegmentVisitor {
-private:
-  const QueryContext& m_context;
-  const std::vector<JSONPathNode>& m_nodes;
-  std::vector<JSONPathNode>* m_out_nodes;
+std::shared_ptr<const ParsedQuery> Env_::parse_cached(std::string_view path) {
+  if (auto cached{m_cache.get(path)}) {
+    return *cached;
+  }
 
-public:
-  SegmentVisitor(const QueryContext& q_ctx,
-                 const std::vector<JSONPathNode>& nodes,
-                 std::vector<JSONPathNode>* out_nodes)
-      : m_context{q_ctx}, m_nodes{nodes}, m_out_nodes{out_nodes} {}
+  auto parsed{std::make_shared<const ParsedQuery>(path, m_parser, m_options,
+                                                   *m_context)};
+  m_cache.put(path, parsed);
+  return parsed;
+}
 
-  ~SegmentVisitor() = default;
+// Each of these hold a reference to the parsed query, through Path_, in case
+// it is evicted from the cache during evaluation, by a filter function, for
+// example.
 
-  void operator()(const Segment& segment) {
-    for (auto node : m_nodes) {
-      SelectorVisitor visitor{m_context, node, m_out_nodes};
-      for (auto selector : segment.selectors) {
-        std::visit(visitor, selector);
-      }
-    }
-  }
+JSONPathNodeList Env_::query(std::string_view path, py::object obj,
+                             std::optional<std::size_t> limit) {
+  return compile(path).query(obj, limit);
+}
 
-  void operator()(const RecursiveSegment& segment) {
-    for (auto node : m_nodes) {
-      std::vector<JSONPathNode> descendants{};
-      descend(node, descendants);
-      for (auto descendant : descendants) {
-        SelectorVisitor visitor{m_context, descendant, m_out_nodes};
-        for (auto selector : segment.selectors) {
-          std::visit(visitor, selector);
-        }
-      }
-    }
-  }
-};
+py::list Env_::findall(std::string_view path, py::object obj) {
+  return compile(path).findall(obj);
+}
 
-JSONPathNodeList resolve_segment(
-    const QueryContext& q_ctx, const JSONPathNodeList& nodes,
-    const std::variant<libjsonpath::Segment, libjsonpath::RecursiveSegment>&
-        segment) {
-  JSONPathNodeList out_nodes{};
-  SegmentVisitor visitor{q_ctx, nodes, &out_nodes};
-  std::visit(visitor, segment);
-  return out_nodes;
+bool Env_::exists(std::string_view path, py::object obj) {
+  return compile(path).exists(obj);
 }
 
-// TODO: Don't pass context around, make all these functions methods of a class.
+std::optional<JSONPathNode> Env_::first(std::string_view path,
+                                        py::object obj) {
+  return compile(path).first(obj);
+}
 
-JSONPathNodeList query_(const segments_t& segments, py::object obj,
-                        function_extension_map functions,
-                        function_signature_map signatures, py::object nothing) {
-  QueryContext q_ctx{obj, functions, signatures, nothing};
-  // Bootstrap the node list with root object and an empty location.
-  JSONPathNodeList nodes{{obj, {}}};
-  for (auto segment : segments) {
-    nodes = resolve_segment(q_ctx, nodes, segment);
-  }
-  return nodes;
+std::size_t Env_::count(std::string_view path, py::object obj) {
+  return compile(path).count(obj);
 }
 
-JSONPathNodeList query_(std::string_view path, py::object obj,
-                        function_extension_map functions,
-                        function_signature_map signatures, py::object nothing) {
-  segments_t segments{parse(path, signatures)};
-  QueryContext q_ctx{obj, functions, signatures, nothing};
-  // Bootstrap the node list with root object and an empty location.
-  JSONPathNodeList nodes{{obj, {}}};
-  for (auto segment : segments) {
-    nodes = resolve_segment(q_ctx, nodes, segment);
-  }
-  return nodes;
+std::vector<JSONPathNodeList> Env_::query_many(std::string_view path,
+                                              py::iterable docs) {
+  return compile(path).query_many(docs);
 }
 
-JSONPathNodeList Env_::query(std::string_view path, py::object obj) {
-  segments_t segments{m_parser.parse(path)};
-  QueryContext q_ctx{obj, m_functions, m_signatures, m_nothing};
-  // Bootstrap the node list with root object and an empty location.
-  JSONPathNodeList nodes{{obj, {}}};
-  for (auto segment : segments) {
-    nodes = resolve_segment(q_ctx, nodes, segment);
+py::list Env_::findall_many(std::string_view path, py::iterable docs) {
+  return compile(path).findall_many(docs);
+}
+
+NodeIterator Env_::iter(std::string_view path, py::object obj) {
+  return compile(path).iter(obj);
+}
+
+QuerySet Env_::query_set(const std::vector<std::string>& paths) {
+  std::vector<std::shared_ptr<const ParsedQuery>> queries{};
+  queries.reserve(paths.size());
+  for (const auto& path : paths) {
+    queries.push_back(parse_cached(path));
   }
-  return nodes;
+  return QuerySet{m_context, std::move(queries)};
 }
 
 JSONPathNodeList Env_::from_segments(const segments_t& segments,
                                      py::object obj) {
-  QueryContext q_ctx{obj, m_functions, m_signatures, m_nothing};
-  // Bootstrap the node list with root object and an empty location.
-  JSONPathNodeList nodes{{obj, {}}};
-  for (auto segment : segments) {
-    nodes = resolve_segment(q_ctx, nodes, segment);
+  QueryContext q_ctx{obj, *m_context, nullptr, nullptr, nullptr};
+  return q_ctx.resolve(segments, obj);
+}
+
+Path_ Env_::compile(std::string_view path) {
+  return Path_{m_context, parse_cached(path)};
+}
+
+segments_t compile_segments(segments_t segments,
+                            const CompileOptions& options) {
+  if (options.fold_constants) {
+    fold_constants(segments);
   }
-  return nodes;
+  if (options.reorder_logical_operands) {
+    reorder_logical_operands(segments);
+  }
+  return segments;
+}
+
+segments_t parse_segments(const Parser& parser, std::string_view path,
+                          const CompileOptions& options) {
+  // Lexing, parsing and compiling don't touch Python objects. Compiling
+  // string literal regular expressions and filter constants does.
+  py::gil_scoped_release release{};
+  return compile_segments(parser.parse(path), options);
 }
 
 segments_t Env_::parse(std::string_view path) { return m_parser.parse(path); }
 
+CacheInfo Env_::cache_info() const { return m_cache.info(); }
+
+void Env_::cache_clear() { m_cache.clear(); }
+
+CacheInfo Env_::regex_cache_info() const {
+  return m_context->regex_cache->info();
+}
+
+void Env_::regex_cache_clear() { m_context->regex_cache->clear(); }
+
 }  // namespace libjsonpath
\ No newline at end of file
@@ -1,40 +1,171 @@
 from __future__ import annotations
 
+import mmap
+import os
+from os import PathLike
 from typing import TYPE_CHECKING
+from typing import BinaryIO
+from typing import Iterable
+from typing import Iterator
 from typing import List
+from typing import Optional
+from typing import Tuple
+from typing import Union
 
-from libjsonpath import query_
 from libjsonpath import to_string
 
-from ._nothing import NOTHING
-
 if TYPE_CHECKING:
     from libjsonpath import JSONPathEnvironment
     from libjsonpath import JSONPathNode
+    from libjsonpath import Path_
     from libjsonpath import Segments
 
 
 class JSONPath:
+    """A compiled JSONPath query.
+
+    A JSONPath is bound to the function extensions registered with its
+    environment at the time it was compiled.
+    """
+
     __slots__ = (
         "environment",
-        "segments",
+        "_path",
     )
 
-    def __init__(self, environment: JSONPathEnvironment, segments: Segments) -> None:
+    def __init__(self, environment: JSONPathEnvironment, path: Path_) -> None:
         self.environment = environment
-        self.segments = segments
+        self._path = path
+
+    @property
+    def segments(self) -> Segments:
+        """The parsed query."""
+        return self._path.segments
 
     def findall(self, data: object) -> List[object]:
-        return [node.value for node in self.query(data)]
-
-    def query(self, data: object) -> List[JSONPathNode]:
-        return query_(
-            self.segments,
-            data,
-            self.environment._function_register,  # noqa: SLF001
-            self.environment._function_signatures,  # noqa: SLF001
-            NOTHING,
-        )
+        return self._path.findall(data)
+
+    def query(self, data: object, limit: Optional[int] = None) -> List[JSONPathNode]:
+        """Return nodes matched by this query, stopping after _limit_ nodes if
+        a limit is given."""
+        return self._path.query(data, limit)
+
+    def query_bytes(
+        self, data: bytes, limit: Optional[int] = None
+    ) -> List[JSONPathNode]:
+        """Return nodes matched by this query in UTF-8 encoded JSON _data_.
+
+        _data_ can be any bytes-like object. It is parsed without creating
+        Python objects for values that don't match. Unlike `json.loads`, a
+        `\\u` escape of a lone surrogate, like `"\\ud800"`, raises a
+        ValueError.
+        """
+        return self._path.query_bytes(data, limit)
+
+    def findall_bytes(self, data: bytes) -> List[object]:
+        """Return values matched by this query in UTF-8 encoded JSON _data_."""
+        return self._path.findall_bytes(data)
+
+    def query_many(self, docs: Iterable[object]) -> List[List[JSONPathNode]]:
+        """Apply this query to each document in _docs_ and return a node list
+        for each one."""
+        return self._path.query_many(docs)
+
+    def findall_many(self, docs: Iterable[object]) -> List[List[object]]:
+        """Apply this query to each document in _docs_ and return a list of
+        values for each one."""
+        return self._path.findall_many(docs)
+
+    def exists(self, data: object) -> bool:
+        """Return True if this query matches at least one node in _data_."""
+        return self._path.exists(data)
+
+    def first(self, data: object) -> Optional[JSONPathNode]:
+        """Return the first node matched by this query, or None."""
+        return self._path.first(data)
+
+    def count(self, data: object) -> int:
+        """Return the number of nodes matched by this query."""
+        return self._path.count(data)
+
+    def iter(self, data: object) -> Iterator[JSONPathNode]:  # noqa: A003
+        """Return an iterator over nodes matched by this query.
+
+        Nodes are selected as the iterator is advanced, so the whole result
+        is never held in memory at once.
+        """
+        return self._path.iter(data)
+
+    def stream(
+        self, source: Union[str, PathLike[str], BinaryIO], chunk_size: int = 65536
+    ) -> Iterator[JSONPathNode]:
+        """Return an iterator over nodes matched by this query in JSON read
+        from _source_, a file name or binary file-like object.
+
+        The document is read _chunk_size_ bytes at a time and nodes are
+        yielded in document order, as they are found. Only values that the
+        query needs to see whole are kept in memory, like the items tested by
+        a filter selector. A query with a filter that refers to the root of
+        the document reads the whole document before yielding anything.
+
+        Document order isn't always the order `query()` returns nodes in.
+        `query()` applies a descendant segment to a node's children before
+        its deeper descendants, so `$..[1]` on `[[7, 8], 9]` gives 9 then 8
+        from `query()`, but 8 then 9 from `stream()`.
+
+        Object members are visited as they are read, so if an object has
+        duplicate keys, each of its members with that key can be yielded.
+        `json.loads` keeps only the last one, as do values that are yielded
+        or filtered whole.
+        """
+        if isinstance(source, (str, PathLike)):
+            with open(source, "rb") as fd:
+                yield from self._path.stream(fd, chunk_size)
+        else:
+            yield from self._path.stream(source, chunk_size)
+
+    def query_ndjson(
+        self,
+        source: Union[str, PathLike[str], bytes],
+        *,
+        threads: Optional[int] = None,
+        chunk_size: int = 1 << 20,
+        ordered: bool = True,
+        as_json: bool = False,
+    ) -> Iterator[Tuple[int, List[object]]]:
+        """Apply this query to each line of newline delimited JSON.
+
+        _source_ is a file name, which is memory-mapped, or a bytes-like
+        object. Lines are parsed and queried in parallel, _chunk_size_ bytes
+        at a time, by _threads_ threads or one per CPU. The GIL is not held
+        while doing so. Function extensions implemented in Python are not
+        supported.
+
+        Yields a (line number, values) tuple for each line with at least one
+        match. Lines are numbered from zero. They are yielded in order,
+        unless _ordered_ is False, in which case they are yielded as soon as
+        they are ready. If _as_json_ is True, values are given as UTF-8
+        encoded JSON bytes instead of Python objects.
+        """
+        if not isinstance(source, (str, PathLike)):
+            yield from self._path.query_ndjson(
+                source, threads or 0, chunk_size, ordered, as_json
+            )
+            return
+
+        with open(source, "rb") as fd:
+            if os.fstat(fd.fileno()).st_size == 0:
+                return
+
+            with mmap.mmap(fd.fileno(), 0, access=mmap.ACCESS_READ) as data:
+                lines = self._path.query_ndjson(
+                    data, threads or 0, chunk_size, ordered, as_json
+                )
+                try:
+                    yield from lines
+                finally:
+                    # The map can't be closed while lines holds a view of it.
+                    del lines
 
     def __repr__(self) -> str:
         return f"<libjsonpath.JSONPath {to_string(self.segments)}>"
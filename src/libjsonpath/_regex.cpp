@@ -0,0 +1,196 @@
+#include <variant>  // std::visit std::holds_alternative std::get
+
+#include "libjsonpath/regex.hpp"
+
+namespace py = pybind11;
+
+namespace libjsonpath {
+
+// The `re` module, imported on first use. It is intentionally never
+// released, as it would otherwise be decremented after the interpreter has
+// been finalized.
+const py::module_& re_module() {
+  static const auto* module{new py::module_(py::module_::import("re"))};
+  return *module;
+}
+
+std::string iregexp_to_python(std::string_view pattern) {
+  std::string rv{};
+  rv.reserve(pattern.size() + 8);
+  bool in_class{false};
+
+  for (std::size_t i{0}; i < pattern.size(); i++) {
+    char c{pattern[i]};
+
+    // Escapes mean the same thing in both dialects.
+    if (c == '\\') {
+      rv.push_back(c);
+      if (i + 1 < pattern.size()) {
+        rv.push_back(pattern[++i]);
+      }
+      continue;
+    }
+
+    if (in_class) {
+      in_class = c != ']';
+      rv.push_back(c);
+      continue;
+    }
+
+    switch (c) {
+      case '[':
+        in_class = true;
+        rv.push_back(c);
+        break;
+      case '.':
+        // I-Regexp's dot does not match carriage returns either.
+        rv.append("[^\\n\\r]");
+        break;
+      case '^':
+      case '$':
+        // I-Regexp has no anchors, these are ordinary characters.
+        rv.push_back('\\');
+        rv.push_back(c);
+        break;
+      default:
+        rv.push_back(c);
+    }
+  }
+
+  return rv;
+}
+
+py::object compile_regex(std::string_view pattern) {
+  try {
+    return re_module().attr("compile")(py::str(iregexp_to_python(pattern)));
+  } catch (py::error_already_set& e) {
+    if (e.matches(re_module().attr("error"))) {
+      return py::none();
+    }
+    throw;
+  }
+}
+
+bool regex_fullmatch(py::handle regex, py::handle string) {
+  if (regex.is_none() || !PyUnicode_Check(string.ptr())) {
+    return false;
+  }
+  return !regex.attr("fullmatch")(string).is_none();
+}
+
+bool regex_search(py::handle regex, py::handle string) {
+  if (regex.is_none() || !PyUnicode_Check(string.ptr())) {
+    return false;
+  }
+  return !regex.attr("search")(string).is_none();
+}
+
+py::object RegexCache::get(std::string_view pattern) {
+  if (auto cached{m_cache.get(pattern)}) {
+    return *cached;
+  }
+
+  auto compiled{compile_regex(pattern)};
+  m_cache.put(pattern, compiled);
+  return compiled;
+}
+
+void collect_literal_regexes(const segments_t& segments,
+                             const native_function_map& native_functions,
+                             regex_map& regexes);
+
+class LiteralRegexVisitor {
+private:
+  const native_function_map& m_native_functions;
+  regex_map& m_regexes;
+
+public:
+  LiteralRegexVisitor(const native_function_map& native_functions,
+                      regex_map& regexes)
+      : m_native_functions{native_functions}, m_regexes{regexes} {}
+
+  void operator()(const NullLiteral&) const {}
+  void operator()(const BooleanLiteral&) const {}
+  void operator()(const IntegerLiteral&) const {}
+  void operator()(const FloatLiteral&) const {}
+  void operator()(const StringLiteral&) const {}
+
+  void operator()(const Box<LogicalNotExpression>& expression) const {
+    std::visit(*this, expression->right);
+  }
+
+  void operator()(const Box<InfixExpression>& expression) const {
+    std::visit(*this, expression->left);
+    std::visit(*this, expression->right);
+  }
+
+  void operator()(const Box<RelativeQuery>& expression) const {
+    collect_literal_regexes(expression->query, m_native_functions, m_regexes);
+  }
+
+  void operator()(const Box<RootQuery>& expression) const {
+    collect_literal_regexes(expression->query, m_native_functions, m_regexes);
+  }
+
+  void operator()(const Box<FunctionCall>& expression) const {
+    for (const auto& arg : expression->args) {
+      std::visit(*this, arg);
+    }
+
+    auto it{m_native_functions.find(std::string{expression->name})};
+    if (it == m_native_functions.end() ||
+        (it->second != NativeFunction::match &&
+         it->second != NativeFunction::search)) {
+      return;
+    }
+
+    if (expression->args.size() == 2 &&
+        std::holds_alternative<StringLiteral>(expression->args[1])) {
+      const auto& pattern{std::get<StringLiteral>(expression->args[1])};
+      m_regexes.emplace(&*expression, compile_regex(pattern.value));
+    }
+  }
+};
+
+class SelectorRegexVisitor {
+private:
+  const LiteralRegexVisitor& m_visitor;
+
+public:
+  SelectorRegexVisitor(const LiteralRegexVisitor& visitor)
+      : m_visitor{visitor} {}
+
+  void operator()(const NameSelector&) const {}
+  void operator()(const IndexSelector&) const {}
+  void operator()(const WildSelector&) const {}
+  void operator()(const SliceSelector&) const {}
+
+  void operator()(const Box<FilterSelector>& selector) const {
+    std::visit(m_visitor, selector->expression);
+  }
+};
+
+void collect_literal_regexes(const segments_t& segments,
+                             const native_function_map& native_functions,
+                             regex_map& regexes) {
+  LiteralRegexVisitor expression_visitor{native_functions, regexes};
+  SelectorRegexVisitor visitor{expression_visitor};
+  for (const auto& segment : segments) {
+    std::visit(
+        [&](const auto& segment_) {
+          for (const auto& selector : segment_.selectors) {
+            std::visit(visitor, selector);
+          }
+        },
+        segment);
+  }
+}
+
+regex_map compile_literal_regexes(
+    const segments_t& segments, const native_function_map& native_functions) {
+  regex_map regexes{};
+  collect_literal_regexes(segments, native_functions, regexes);
+  return regexes;
+}
+
+}  // namespace libjsonpath
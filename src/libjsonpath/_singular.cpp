@@ -0,0 +1,75 @@
+#include <cstddef>   // std::size_t
+#include <cstdint>   // std::int64_t
+#include <optional>  // std::optional
+#include <variant>   // std::get_if
+
+#include "libjsonpath/names.hpp"
+#include "libjsonpath/selectors.hpp"
+#include "libjsonpath/singular.hpp"
+
+namespace py = pybind11;
+
+namespace libjsonpath {
+
+std::optional<SingularQuery> compile_singular_query(
+    const segments_t& segments) {
+  SingularQuery query{};
+  for (const auto& segment : segments) {
+    auto segment_{std::get_if<Segment>(&segment)};
+    if (!segment_ || segment_->selectors.size() != 1) {
+      return std::nullopt;
+    }
+
+    const auto& selector{segment_->selectors[0]};
+    if (auto name{std::get_if<NameSelector>(&selector)}) {
+      query.steps.push_back({name_key(name->name), 0});
+    } else if (auto index{std::get_if<IndexSelector>(&selector)}) {
+      query.steps.push_back({py::object{}, index->index});
+    } else {
+      return std::nullopt;
+    }
+  }
+  return query;
+}
+
+py::object lookup_step(const SingularQuery::Step& step, py::handle obj,
+                       std::size_t& index) {
+  if (step.name) {
+    if (!PyDict_Check(obj.ptr())) {
+      return py::object{};
+    }
+    auto value{PyDict_GetItemWithError(obj.ptr(), step.name.ptr())};
+    if (!value && PyErr_Occurred()) {
+      throw py::error_already_set();
+    }
+    return py::reinterpret_borrow<py::object>(value);
+  }
+
+  if (!PyList_Check(obj.ptr())) {
+    return py::object{};
+  }
+
+  auto length{PyList_GET_SIZE(obj.ptr())};
+  auto index_{step.index < 0 ? step.index + length : step.index};
+  if (index_ < 0 || index_ >= length) {
+    return py::object{};
+  }
+
+  index = static_cast<std::size_t>(index_);
+  return py::reinterpret_borrow<py::object>(
+      PyList_GET_ITEM(obj.ptr(), index_));
+}
+
+py::object lookup(const SingularQuery& query, py::handle obj) {
+  auto value{py::reinterpret_borrow<py::object>(obj)};
+  std::size_t index{0};
+  for (const auto& step : query.steps) {
+    value = lookup_step(step, value, index);
+    if (!value) {
+      break;
+    }
+  }
+  return value;
+}
+
+}  // namespace libjsonpath
@@ -0,0 +1,552 @@
+#include <cstddef>      // std::size_t
+#include <cstdint>      // std::int64_t std::uint32_t
+#include <deque>        // std::deque
+#include <limits>       // std::numeric_limits
+#include <optional>     // std::optional
+#include <string>       // std::string std::to_string
+#include <string_view>  // std::string_view
+#include <utility>      // std::move
+#include <variant>      // std::visit
+#include <vector>       // std::vector
+
+#include "libjsonpath/frozen.hpp"
+#include "libjsonpath/path.hpp"
+#include "libjsonpath/selectors.hpp"
+
+namespace py = pybind11;
+
+namespace libjsonpath {
+
+using namespace std::string_literals;
+
+namespace {
+
+bool is_whitespace(int c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+// Return true if _segments_ contain a root query anywhere, including inside
+// nested filters and function arguments.
+bool has_root_query(const segments_t& segments);
+
+class RootQueryVisitor {
+public:
+  bool operator()(const NullLiteral&) const { return false; }
+  bool operator()(const BooleanLiteral&) const { return false; }
+  bool operator()(const IntegerLiteral&) const { return false; }
+  bool operator()(const FloatLiteral&) const { return false; }
+  bool operator()(const StringLiteral&) const { return false; }
+
+  bool operator()(const Box<LogicalNotExpression>& expression) const {
+    return std::visit(*this, expression->right);
+  }
+
+  bool operator()(const Box<InfixExpression>& expression) const {
+    return std::visit(*this, expression->left) ||
+           std::visit(*this, expression->right);
+  }
+
+  bool operator()(const Box<RelativeQuery>& expression) const {
+    return has_root_query(expression->query);
+  }
+
+  bool operator()(const Box<RootQuery>&) const { return true; }
+
+  bool operator()(const Box<FunctionCall>& expression) const {
+    for (const auto& arg : expression->args) {
+      if (std::visit(*this, arg)) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+bool has_root_query(const segments_t& segments) {
+  for (const auto& segment : segments) {
+    auto found{std::visit(
+        [](const auto& segment_) {
+          for (const auto& selector : segment_.selectors) {
+            auto filter{std::get_if<Box<FilterSelector>>(&selector)};
+            if (filter &&
+                std::visit(RootQueryVisitor{}, (*filter)->expression)) {
+              return true;
+            }
+          }
+          return false;
+        },
+        segment)};
+
+    if (found) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Return the selector of _segment_ if it can be applied to the items of an
+// array or object one at a time, in document order, without seeing the
+// whole array or object. That is a segment with a single name, non-negative
+// index, wildcard or filter selector, or a slice selector with a positive
+// step and no negative bounds.
+const selector_t* streamable_selector(const segments_t::value_type& segment) {
+  const auto& selectors{std::visit(
+      [](const auto& segment_) -> const std::vector<selector_t>& {
+        return segment_.selectors;
+      },
+      segment)};
+
+  if (selectors.size() != 1) {
+    return nullptr;
+  }
+
+  const auto& selector{selectors[0]};
+  if (std::holds_alternative<IndexSelector>(selector)) {
+    return std::get<IndexSelector>(selector).index >= 0 ? &selector : nullptr;
+  }
+
+  if (std::holds_alternative<SliceSelector>(selector)) {
+    const auto& slice{std::get<SliceSelector>(selector)};
+    if (slice.step.value_or(1) <= 0 || slice.start.value_or(0) < 0 ||
+        slice.stop.value_or(0) < 0) {
+      return nullptr;
+    }
+  }
+
+  return &selector;
+}
+
+// Reads a binary file-like object a chunk at a time, optionally copying
+// consumed bytes to a capture buffer.
+class ChunkReader {
+public:
+  ChunkReader(py::object file, std::size_t chunk_size)
+      : m_read{file.attr("read")}, m_chunk_size{chunk_size} {}
+
+  // Return the next byte without consuming it, or -1 at the end of the file.
+  int peek() {
+    if (m_pos == m_buffer.size() && !fill()) {
+      return -1;
+    }
+    return static_cast<unsigned char>(m_buffer[m_pos]);
+  }
+
+  // Consume and return the next byte, or -1 at the end of the file.
+  int next() {
+    auto c{peek()};
+    if (c != -1) {
+      m_pos++;
+    }
+    return c;
+  }
+
+  // Copy bytes to _capture_ as they are consumed, until end_capture is
+  // called.
+  void begin_capture(std::string& capture) {
+    m_capture = &capture;
+    m_capture_start = m_pos;
+  }
+
+  void end_capture() {
+    m_capture->append(m_buffer, m_capture_start, m_pos - m_capture_start);
+    m_capture = nullptr;
+  }
+
+  std::size_t offset() const { return m_offset + m_pos; }
+
+private:
+  py::object m_read;
+  std::size_t m_chunk_size;
+  std::string m_buffer{};
+  std::size_t m_pos{0};
+  std::size_t m_offset{0};
+  bool m_eof{false};
+
+  std::string* m_capture{nullptr};
+  std::size_t m_capture_start{0};
+
+  bool fill() {
+    if (m_eof) {
+      return false;
+    }
+
+    if (m_capture) {
+      m_capture->append(m_buffer, m_capture_start);
+      m_capture_start = 0;
+    }
+
+    py::object chunk{m_read(m_chunk_size)};
+    if (!PyObject_CheckBuffer(chunk.ptr())) {
+      throw py::type_error("expected a binary file, read() returned '"s +
+                           Py_TYPE(chunk.ptr())->tp_name + "'"s);
+    }
+
+    py::buffer_info info{py::reinterpret_borrow<py::buffer>(chunk).request()};
+    m_offset += m_buffer.size();
+    m_buffer.assign(static_cast<const char*>(info.ptr),
+                    static_cast<std::size_t>(info.size * info.itemsize));
+    m_pos = 0;
+    m_eof = m_buffer.empty();
+    return !m_eof;
+  }
+};
+
+// A step of the query waiting to be applied to a value in the stream. If
+// _filter_ is set, the value is an item tested by the filter selector of
+// segment _segment_, and the segments after it are applied if it passes.
+// Otherwise segments from _segment_ on are applied to the value.
+struct StreamState {
+  std::size_t segment;
+  bool filter;
+};
+
+// An array or object being read from the stream, and the query states that
+// apply to it.
+struct StreamFrame {
+  bool object;
+  std::vector<StreamState> states;
+  location_link_t location;
+  std::size_t length{0};
+};
+
+}  // namespace
+
+struct StreamIterator::State {
+  State(std::shared_ptr<const EvaluationContext> context_,
+        std::shared_ptr<const ParsedQuery> query_, py::object file,
+        std::size_t chunk_size)
+      : context{std::move(context_)},
+        query{std::move(query_)},
+        reader{file, chunk_size} {
+    // A filter that refers to the root of the document can't be evaluated
+    // one item at a time, so the whole document is read at once.
+    if (!has_root_query(query->segments)) {
+      for (const auto& segment : query->segments) {
+        selectors.push_back(streamable_selector(segment));
+      }
+    } else {
+      selectors.resize(query->segments.size(), nullptr);
+    }
+    states.push_back({0, false});
+  }
+
+  std::shared_ptr<const EvaluationContext> context;
+  std::shared_ptr<const ParsedQuery> query;
+  ChunkReader reader;
+
+  // The selector of each segment that can be applied one item at a time, or
+  // nullptr if the segment can't be streamed.
+  std::vector<const selector_t*> selectors{};
+
+  std::vector<StreamFrame> stack{};
+
+  // The query states and location of the next value to read.
+  std::vector<StreamState> states{};
+  location_link_t location{};
+
+  std::deque<JSONPathNode> ready{};
+  bool finished{false};
+
+  [[noreturn]] void error(const std::string& message) {
+    throw py::value_error(message + " at offset "s +
+                          std::to_string(reader.offset()));
+  }
+
+  void skip_whitespace() {
+    while (is_whitespace(reader.peek())) {
+      reader.next();
+    }
+  }
+
+  void skip_string() {
+    reader.next();  // opening quote
+    for (;;) {
+      auto c{reader.next()};
+      if (c == -1) {
+        error("unterminated string");
+      }
+      if (c == '"') {
+        return;
+      }
+      if (c == '\\' && reader.next() == -1) {
+        error("unterminated string");
+      }
+    }
+  }
+
+  // Consume the next value, only checking that brackets are balanced. Values
+  // that are kept are fully validated when they are parsed.
+  void skip_value() {
+    skip_whitespace();
+    auto c{reader.peek()};
+
+    if (c == '"') {
+      skip_string();
+      return;
+    }
+
+    if (c == '[' || c == '{') {
+      std::size_t depth{0};
+      do {
+        c = reader.peek();
+        if (c == -1) {
+          error("unexpected end of data");
+        }
+        if (c == '"') {
+          skip_string();
+          continue;
+        }
+        reader.next();
+        if (c == '[' || c == '{') {
+          depth++;
+        } else if (c == ']' || c == '}') {
+          depth--;
+        }
+      } while (depth > 0);
+      return;
+    }
+
+    // A number, true, false, null, NaN or Infinity.
+    std::size_t length{0};
+    while ((c = reader.peek()) != -1 &&
+           ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+            (c >= 'A' && c <= 'Z') || c == '-' || c == '+' || c == '.')) {
+      reader.next();
+      length++;
+    }
+
+    if (length == 0) {
+      error("expected a value");
+    }
+  }
+
+  std::string read_key() {
+    skip_whitespace();
+    if (reader.peek() != '"') {
+      error("expected a string key");
+    }
+
+    std::string raw{};
+    reader.begin_capture(raw);
+    skip_string();
+    reader.end_capture();
+
+    std::string_view key{raw};
+    key = key.substr(1, key.size() - 2);
+    for (auto c : key) {
+      if (c == '\\' || static_cast<unsigned char>(c) >= 0x80) {
+        // Decode escape sequences and check encoding with the JSON parser.
+        auto doc{FrozenDocument::from_json(raw)};
+        return std::string{doc.string(doc.node(0).string)};
+      }
+    }
+    return std::string{key};
+  }
+
+  void expect(char c) {
+    skip_whitespace();
+    if (reader.next() != c) {
+      error("expected '"s + c + "'"s);
+    }
+  }
+
+  bool needs_capture() const {
+    for (const auto& state : states) {
+      if (state.filter || state.segment == selectors.size() ||
+          !selectors[state.segment]) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Read the next value whole and apply each state to it.
+  void capture() {
+    std::string json{};
+    skip_whitespace();
+    reader.begin_capture(json);
+    skip_value();
+    reader.end_capture();
+
+    auto doc{FrozenDocument::from_json(json)};
+    const auto& segments{query->segments};
+
+    for (const auto& state : states) {
+      auto first{segments.begin() + state.segment};
+      if (state.filter) {
+        const auto& selector{
+            std::get<Box<FilterSelector>>(*selectors[state.segment])};
+        auto passed{test_frozen(doc, *context, *query, *selector)};
+        if (!passed) {
+          python_function_error();
+        }
+        if (!*passed) {
+          continue;
+        }
+        first++;
+      }
+
+      auto nodes{resolve_frozen(doc, *context, *query, first,
+                                std::numeric_limits<std::size_t>::max())};
+      if (!nodes) {
+        python_function_error();
+      }
+
+      for (auto index : *nodes) {
+        ready.emplace_back(doc.to_python(index), doc.location(index, location));
+      }
+    }
+  }
+
+  [[noreturn]] void python_function_error() {
+    throw py::type_error(
+        "can't stream a query that calls a function extension implemented "
+        "in Python");
+  }
+
+  // Set states to those that apply to the item of _frame_ at _key_ or
+  // _index_.
+  void item_states(const StreamFrame& frame, const std::string* key,
+                   std::size_t index) {
+    states.clear();
+    for (const auto& state : frame.states) {
+      const auto& selector{*selectors[state.segment]};
+      bool selected{false};
+
+      if (std::holds_alternative<NameSelector>(selector)) {
+        selected = key && *key == std::get<NameSelector>(selector).name;
+      } else if (std::holds_alternative<IndexSelector>(selector)) {
+        selected = !key && static_cast<std::int64_t>(index) ==
+                               std::get<IndexSelector>(selector).index;
+      } else if (std::holds_alternative<WildSelector>(selector)) {
+        selected = true;
+      } else if (std::holds_alternative<SliceSelector>(selector)) {
+        const auto& slice{std::get<SliceSelector>(selector)};
+        auto i{static_cast<std::int64_t>(index)};
+        auto start{slice.start.value_or(0)};
+        selected = !key && i >= start && (!slice.stop || i < *slice.stop) &&
+                   (i - start) % slice.step.value_or(1) == 0;
+      } else {
+        states.push_back({state.segment, true});
+      }
+
+      if (selected) {
+        states.push_back({state.segment + 1, false});
+      }
+
+      if (std::holds_alternative<RecursiveSegment>(
+              query->segments[state.segment])) {
+        states.push_back(state);
+      }
+    }
+  }
+
+  // Read the value described by states and location, then move on to the
+  // next value that might contain a match.
+  void step() {
+    skip_whitespace();
+    auto c{reader.peek()};
+
+    if (states.empty()) {
+      skip_value();
+    } else if (needs_capture()) {
+      capture();
+    } else if (c == '[' || c == '{') {
+      reader.next();
+      stack.push_back(
+          StreamFrame{c == '{', std::move(states), std::move(location)});
+      advance(true);
+      return;
+    } else {
+      // A scalar has no children for the remaining segments to select.
+      skip_value();
+    }
+
+    advance(false);
+  }
+
+  // Find the next item of the innermost open array or object. _opened_ is
+  // true if that array or object was opened by the last step.
+  void advance(bool opened) {
+    for (;;) {
+      if (stack.empty()) {
+        skip_whitespace();
+        if (reader.peek() != -1) {
+          error("unexpected data after JSON value");
+        }
+        finished = true;
+        return;
+      }
+
+      auto& frame{stack.back()};
+      skip_whitespace();
+      auto c{reader.peek()};
+
+      if (c == (frame.object ? '}' : ']')) {
+        reader.next();
+        stack.pop_back();
+        opened = false;
+        continue;
+      }
+
+      if (!opened) {
+        if (c != ',') {
+          error(frame.object ? "expected ',' or '}'"s : "expected ',' or ']'"s);
+        }
+        reader.next();
+      }
+
+      auto index{frame.length++};
+      if (frame.object) {
+        auto key{read_key()};
+        expect(':');
+        item_states(frame, &key, index);
+        if (!states.empty()) {
+          location = extend_location(frame.location, py::str(key));
+        }
+      } else {
+        item_states(frame, nullptr, index);
+        if (!states.empty()) {
+          location = extend_location(frame.location, index);
+        }
+      }
+      return;
+    }
+  }
+};
+
+StreamIterator::StreamIterator(std::shared_ptr<const EvaluationContext> context,
+                               std::shared_ptr<const ParsedQuery> query,
+                               py::object file, std::size_t chunk_size)
+    : m_state{std::make_unique<State>(std::move(context), std::move(query),
+                                      file, chunk_size)} {}
+
+StreamIterator::StreamIterator(StreamIterator&& other) noexcept = default;
+
+StreamIterator::~StreamIterator() = default;
+
+std::optional<JSONPathNode> StreamIterator::next() {
+  auto& state{*m_state};
+  while (state.ready.empty() && !state.finished) {
+    state.step();
+  }
+
+  if (state.ready.empty()) {
+    return std::nullopt;
+  }
+
+  JSONPathNode node{std::move(state.ready.front())};
+  state.ready.pop_front();
+  return node;
+}
+
+StreamIterator Path_::stream(py::object file, std::size_t chunk_size) const {
+  return StreamIterator{m_context, m_query, file, chunk_size};
+}
+
+StreamIterator Env_::stream(std::string_view path, py::object file,
+                            std::size_t chunk_size) {
+  return compile(path).stream(file, chunk_size);
+}
+
+}  // namespace libjsonpath
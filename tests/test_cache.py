@@ -0,0 +1,105 @@
+import gc
+from concurrent.futures import ThreadPoolExecutor
+from typing import List
+
+import libjsonpath
+import pytest
+from libjsonpath import JSONPathEnvironment
+
+
+def test_repeated_query_hits_cache() -> None:
+    """Test that repeated query strings are parsed once."""
+    env = JSONPathEnvironment()
+    data = {"a": [1, 2, 3]}
+    assert env.findall("$.a[0]", data) == [1]
+    assert env.findall("$.a[0]", data) == [1]
+    info = env.cache_info()
+    assert info.misses == 1
+    assert info.hits == 1
+    assert info.size == 1
+
+
+def test_least_recently_used_query_is_evicted() -> None:
+    """Test that the cache is bounded."""
+
+    class SmallCacheEnvironment(JSONPathEnvironment):
+        cache_size = 2
+
+    env = SmallCacheEnvironment()
+    data = {"a": 1, "b": 2, "c": 3}
+    env.query("$.a", data)
+    env.query("$.b", data)
+    env.query("$.a", data)
+    env.query("$.c", data)  # evicts $.b
+    env.query("$.a", data)
+    env.query("$.b", data)
+    info = env.cache_info()
+    assert info.capacity == 2  # noqa: PLR2004
+    assert info.size == 2  # noqa: PLR2004
+    assert info.hits == 2  # noqa: PLR2004
+    assert info.misses == 4  # noqa: PLR2004
+    assert info.evictions == 2  # noqa: PLR2004
+
+
+def test_clear_cache() -> None:
+    """Test that we can empty the cache and reset its counters."""
+    env = JSONPathEnvironment()
+    env.query("$.a", {"a": 1})
+    env.cache_clear()
+    info = env.cache_info()
+    assert info.size == 0
+    assert info.misses == 0
+
+
+def test_register_function_invalidates_cache() -> None:
+    """Test that registering a function discards cached queries."""
+    env = JSONPathEnvironment()
+    env.query("$.a", {"a": 1})
+    env.register_function("count", libjsonpath.functions.Count())
+    assert env.cache_info().size == 0
+
+
+def test_invalid_queries_are_not_cached() -> None:
+    """Test that queries that fail to parse are not cached."""
+    env = JSONPathEnvironment()
+    with pytest.raises(libjsonpath.JSONPathException):
+        env.query("$.a[", {"a": 1})
+    assert env.cache_info().size == 0
+
+
+def test_cached_query_outlives_query_string() -> None:
+    """Test that cached queries don't refer to the caller's query string."""
+    env = JSONPathEnvironment()
+    query = "".join(["$.store.book", "[?@.author]", ".title"])
+    env.compile(query)
+    del query
+    gc.collect()
+    junk = ["!" * 28 for _ in range(1000)]  # noqa: F841
+
+    path = env.compile("$.store.book[?@.author].title")
+    assert env.cache_info().hits == 1
+    selector = path.segments[0].selectors[0]
+    assert selector.token.value == "store"
+    assert selector.token.query == "$.store.book[?@.author].title"
+    assert path.segments[3].selectors[0].token.value == "title"
+
+
+def test_share_environment_between_threads() -> None:
+    """Test that an environment and its cache can be used from many threads."""
+
+    class SmallCacheEnvironment(JSONPathEnvironment):
+        cache_size = 8
+
+    env = SmallCacheEnvironment()
+    data = {"a": list(range(100))}
+
+    def task(n: int) -> List[object]:
+        return [env.findall(f"$.a[{(n + i) % 100}]", data) for i in range(50)]
+
+    with ThreadPoolExecutor(max_workers=8) as pool:
+        results = list(pool.map(task, range(32)))
+
+    assert results == [[[(n + i) % 100] for i in range(50)] for n in range(32)]
+    info = env.cache_info()
+    assert info.hits + info.misses == 32 * 50  # noqa: PLR2004
+    assert info.size <= 8  # noqa: PLR2004
@@ -0,0 +1,67 @@
+import pytest
+
+import libjsonpath
+from libjsonpath import JSONPathEnvironment
+
+
+class FoldingEnvironment(JSONPathEnvironment):
+    fold_constants = True
+
+
+DATA = {
+    "a": [
+        {"x": 1, "y": "a"},
+        {"x": 2},
+        {"y": "b"},
+        [1, 2],
+        None,
+    ]
+}
+
+
+@pytest.mark.parametrize(
+    ("query", "want"),
+    [
+        ("$.a[?1 == 1 && @.x == 1]", "$.a[?@.x == 1]"),
+        ("$.a[?@.x == 1 || 1 == 2]", "$.a[?@.x == 1]"),
+        ("$.a[?!(1 == 2) || @.y]", "$.a[*]"),
+        ("$.a[?@.x && @.x]", "$.a[?@.x]"),
+        ("$.a[?@.x || !@.x]", "$.a[*]"),
+        ("$.a[?'a' < 'b'].x", "$.a[*].x"),
+        ("$.a[?!(!@.y)]", "$.a[?@.y]"),
+        ("$.a[?true == 1].x", "$.a[*].x"),
+        ("$.a[?1 == 1.0 && @.x]", "$.a[?@.x]"),
+    ],
+)
+def test_fold_constants(query: str, want: str) -> None:
+    """Test that filters are simplified without changing their results."""
+    path = FoldingEnvironment().compile(query)
+    assert libjsonpath.to_string(path.segments) == libjsonpath.to_string(
+        libjsonpath.parse(want)
+    )
+    assert path.findall(DATA) == libjsonpath.findall(query, DATA)
+
+
+@pytest.mark.parametrize(
+    "query",
+    [
+        "$.a[?1 == 2].x",
+        "$..[?1 == 2]..x",
+        "$.a[?@.x && @[?1 > 2]].x",
+        "$.a[?9007199254740993 == 9007199254740992.0]",
+        "$.a[?true < 2]",
+    ],
+)
+def test_always_false_filters_are_removed(query: str) -> None:
+    """Test that segments after a filter that is always false are removed."""
+    path = FoldingEnvironment().compile(query)
+    assert not path.segments[-1].selectors
+    assert path.findall(DATA) == []
+
+
+def test_constants_are_not_folded_by_default() -> None:
+    """Test that folding constants is opt in."""
+    path = libjsonpath.compile("$.a[?1 == 1 && @.x == 1]")
+    assert isinstance(
+        path.segments[1].selectors[0].expression, libjsonpath.InfixExpression
+    )
@@ -0,0 +1,300 @@
+import gc
+import json
+
+import pytest
+
+import libjsonpath
+from libjsonpath import FrozenDocument
+from libjsonpath import JSONPathEnvironment
+
+DATA = {
+    "store": {
+        "book": [
+            {"title": "a", "price": 8.95, "tags": ["x", "y"], "isbn": "0-553"},
+            {"title": "b", "price": 12, "tags": []},
+            {"title": "c", "price": 8, "tags": ["y"], "isbn": "0-395"},
+            {"title": "d", "price": 22.99, "tags": ["été"]},
+        ],
+        "bicycle": {"color": "red", "price": 399, "sold": False},
+    },
+    "limit": 10,
+    "none": None,
+}
+
+QUERIES = [
+    "$",
+    "$.store.book[*].title",
+    "$..price",
+    "$..*",
+    "$.store.book[-1]",
+    "$.store.book[1:3].title",
+    "$.store.book[::-2].title",
+    "$.store.book[?@.isbn].title",
+    "$.store.book[?!@.isbn].title",
+    "$.store.book[?@.price < $.limit].title",
+    "$.store.book[?@.price == 8].title",
+    "$.store.book[?@.tags == @.tags].title",
+    "$.store.book[?count(@.tags) > 1].title",
+    "$.store.book[?length(@.tags[0]) == 3].title",
+    "$.store.book[?value(@.tags[0]) == 'y'].title",
+    "$.store.book[?match(@.title, '[ab]')].title",
+    "$.store.book[?search(@.isbn, '39')].title",
+    "$..[?@.sold == false].color",
+    "$[?@ == null]",
+    "$.nosuchthing",
+]
+
+
+@pytest.mark.parametrize("query", QUERIES)
+def test_frozen_matches_python(query: str) -> None:
+    """Test that querying a frozen document gives the same results."""
+    doc = FrozenDocument(DATA)
+    path = libjsonpath.compile(query)
+    assert path.findall(doc) == path.findall(DATA)
+    assert [(node.path(), node.value) for node in path.query(doc)] == [
+        (node.path(), node.value) for node in path.query(DATA)
+    ]
+
+
+@pytest.mark.parametrize(
+    ("data", "query"),
+    [
+        ([True, 1, 1.0, False, 0, "1"], "$[?@ == 1]"),
+        ([True, 1, 1.0, False, 0, "1"], "$[?@ == true]"),
+        ([True, 1, 0.5, False, 0], "$[?@ < 1]"),
+        ([9007199254740993, 9007199254740992.0], "$[?@ == 9007199254740992]"),
+        ([9007199254740993, 9007199254740992.0], "$[?@ > 9007199254740992.0]"),
+        ([[1, True], [True, 1.0], {"a": 0}, {"a": False}], "$[?@ == $[0]]"),
+        ([[1, True], [True, 1.0], {"a": 0}, {"a": False}], "$[?@ == $[2]]"),
+    ],
+)
+def test_frozen_comparisons_match_python(data: object, query: str) -> None:
+    """Test that frozen values compare like the Python values they came from."""
+    path = libjsonpath.compile(query)
+    assert path.findall(FrozenDocument(data)) == path.findall(data)
+
+
+def test_frozen_query_limit() -> None:
+    """Test that query limits apply to frozen documents."""
+    doc = FrozenDocument(DATA)
+    nodes = libjsonpath.query("$..price", doc, limit=2)
+    assert [node.value for node in nodes] == [8.95, 12]
+
+
+def test_frozen_python_function_extension() -> None:
+    """Test that Python function extensions still work."""
+
+    class Upper(libjsonpath.FilterFunction):
+        arg_types = (libjsonpath.ExpressionType.value,)
+        return_type = libjsonpath.ExpressionType.value
+
+        def __call__(self, obj: object) -> object:
+            return obj.upper() if isinstance(obj, str) else obj
+
+    env = JSONPathEnvironment()
+    env.register_function("upper", Upper())
+    query = "$.store.book[?upper(@.title) == 'C'].price"
+    assert env.findall(query, FrozenDocument(DATA)) == [8]
+
+
+@pytest.mark.parametrize("query", QUERIES)
+def test_frozen_exists(query: str) -> None:
+    """Test that exists reads frozen documents."""
+    path = libjsonpath.compile(query)
+    assert path.exists(FrozenDocument(DATA)) == path.exists(DATA)
+    assert libjsonpath.exists(query, FrozenDocument(DATA)) == path.exists(DATA)
+
+
+@pytest.mark.parametrize("query", QUERIES)
+def test_frozen_first(query: str) -> None:
+    """Test that first reads frozen documents."""
+    path = libjsonpath.compile(query)
+    expect = path.first(DATA)
+    for node in (
+        path.first(FrozenDocument(DATA)),
+        libjsonpath.first(query, FrozenDocument(DATA)),
+    ):
+        if expect is None:
+            assert node is None
+        else:
+            assert node is not None
+            assert (node.path(), node.value) == (expect.path(), expect.value)
+
+
+@pytest.mark.parametrize("query", QUERIES)
+def test_frozen_count(query: str) -> None:
+    """Test that count reads frozen documents."""
+    path = libjsonpath.compile(query)
+    assert path.count(FrozenDocument(DATA)) == path.count(DATA)
+    assert libjsonpath.count(query, FrozenDocument(DATA)) == path.count(DATA)
+
+
+@pytest.mark.parametrize("query", QUERIES)
+def test_frozen_iter(query: str) -> None:
+    """Test that iter reads frozen documents."""
+    path = libjsonpath.compile(query)
+    expect = [(node.path(), node.value) for node in path.iter(DATA)]
+    assert [
+        (node.path(), node.value) for node in path.iter(FrozenDocument(DATA))
+    ] == expect
+
+    env = JSONPathEnvironment()
+    assert [
+        (node.path(), node.value)
+        for node in env.iter(query, FrozenDocument(DATA))
+    ] == expect
+
+
+def test_frozen_iter_keeps_document_alive() -> None:
+    """Test that an iterator over a frozen document keeps it alive."""
+    it = libjsonpath.compile("$..price").iter(FrozenDocument(DATA))
+    gc.collect()
+    assert [node.value for node in it] == libjsonpath.findall("$..price", DATA)
+
+
+def test_frozen_iter_python_function_extension() -> None:
+    """Test that iterating with Python function extensions still works."""
+
+    class Upper(libjsonpath.FilterFunction):
+        arg_types = (libjsonpath.ExpressionType.value,)
+        return_type = libjsonpath.ExpressionType.value
+
+        def __call__(self, obj: object) -> object:
+            return obj.upper() if isinstance(obj, str) else obj
+
+    env = JSONPathEnvironment()
+    env.register_function("upper", Upper())
+    query = "$.store.book[?upper(@.title) == 'C'].price"
+    assert [node.value for node in env.iter(query, FrozenDocument(DATA))] == [8]
+
+
+def test_frozen_query_many() -> None:
+    """Test that query_many and findall_many read frozen documents."""
+    other = {"store": {"book": [{"price": 1}]}}
+    docs = [FrozenDocument(DATA), other, FrozenDocument(other)]
+    path = libjsonpath.compile("$..price")
+    expect = path.findall_many([DATA, other, other])
+    assert path.findall_many(docs) == expect
+    assert [
+        [node.value for node in nodes] for nodes in path.query_many(docs)
+    ] == expect
+
+    env = JSONPathEnvironment()
+    assert env.findall_many("$..price", docs) == expect
+
+
+def test_frozen_query_set() -> None:
+    """Test that query sets read frozen documents."""
+    env = JSONPathEnvironment()
+    query_set = env.query_set(QUERIES)
+    doc = FrozenDocument(DATA)
+    assert query_set.findall(doc) == query_set.findall(DATA)
+    assert [
+        [(node.path(), node.value) for node in nodes]
+        for nodes in query_set.query(doc)
+    ] == [
+        [(node.path(), node.value) for node in nodes]
+        for nodes in query_set.query(DATA)
+    ]
+
+
+def test_frozen_member_lookup() -> None:
+    """Test that members of large objects are found by name, whether the
+    document was frozen from Python objects or parsed from JSON."""
+    data = {f"k{i}": i for i in range(1000, 0, -1)}
+    data["nested"] = {"b": 2, "a": 1}
+    queries = ["$.k1", "$.k500", "$.k1000", "$.k0", "$.nested.a", "$['']"]
+    for doc in (FrozenDocument(data), FrozenDocument.from_json(json.dumps(data))):
+        for query in queries:
+            assert libjsonpath.findall(query, doc) == libjsonpath.findall(
+                query, data
+            )
+
+
+@pytest.mark.parametrize(
+    "query",
+    [
+        "$[?@[0] == @[1]]",
+        "$[?@[0] == @[2]]",
+    ],
+)
+def test_frozen_objects_equal_in_any_key_order(query: str) -> None:
+    """Test that objects compare equal whatever order their keys are in."""
+    data = [[{"a": 1, "b": 2, "c": 3}, {"c": 3, "b": 2, "a": 1}, {"a": 1}]]
+    for doc in (FrozenDocument(data), FrozenDocument.from_json(json.dumps(data))):
+        assert libjsonpath.findall(query, doc) == libjsonpath.findall(query, data)
+
+
+def test_frozen_to_python() -> None:
+    """Test that a frozen document can be converted back to Python objects."""
+    assert FrozenDocument(DATA).to_python() == DATA
+
+
+def test_cant_freeze_arbitrary_objects() -> None:
+    """Test that only JSON-like data can be frozen."""
+    with pytest.raises(TypeError):
+        FrozenDocument({"a": (1, 2)})
+
+    with pytest.raises(TypeError):
+        FrozenDocument({1: "a"})
+
+
+@pytest.mark.parametrize("query", QUERIES)
+def test_query_bytes_matches_python(query: str) -> None:
+    """Test that querying JSON bytes gives the same results as json.loads."""
+    data = json.dumps(DATA).encode()
+    path = libjsonpath.compile(query)
+    assert path.findall_bytes(data) == path.findall(DATA)
+    assert [(node.path(), node.value) for node in path.query_bytes(data)] == [
+        (node.path(), node.value) for node in path.query(DATA)
+    ]
+
+
+def test_query_bytes_accepts_buffers() -> None:
+    """Test that any bytes-like object can be queried."""
+    data = b'{"a": [1, 2, 3]}'
+    assert libjsonpath.DEFAULT_ENV.findall_bytes("$.a[1]", bytearray(data)) == [2]
+    assert libjsonpath.DEFAULT_ENV.findall_bytes("$.a[1]", memoryview(data)) == [2]
+
+
+@pytest.mark.parametrize(
+    "data",
+    [
+        b'{"a": "\\u00e9\\ud83d\\ude00", "b": [1.5e3, -0, true, null]}',
+        b'{"a": 1, "a": 2, "b": [[], {}]}',
+        b'{"a": {"a": 1}, "a": 2}',
+        b'{"a": 1, "b": {"a": 2, "b": {"a": 3}}, "b": 4, "a": 5}',
+        b"[NaN, Infinity, -Infinity, 1e400]",
+        ("\ufeff" + '"\u00e9"').encode(),
+        b"[" * 500 + b"]" * 500,
+    ],
+)
+def test_from_json_matches_json_loads(data: bytes) -> None:
+    """Test that parsed JSON is equal to the result of json.loads."""
+    doc = FrozenDocument.from_json(data)
+    assert repr(doc.to_python()) == repr(json.loads(data))
+    for query in ("$.a", "$.*", "$..*"):
+        assert libjsonpath.findall(query, doc) == libjsonpath.findall(
+            query, json.loads(data)
+        )
+
+
+@pytest.mark.parametrize(
+    "data",
+    [b"", b"[1,]", b'{"a" 1}', b"[1] 2", b'"\x01"', b'"\xff"', b"01", b"1" * 30],
+)
+def test_invalid_json(data: bytes) -> None:
+    """Test that invalid JSON raises a ValueError."""
+    with pytest.raises(ValueError):  # noqa: PT011
+        FrozenDocument.from_json(data)
+
+
+@pytest.mark.parametrize("data", [b'"\\ud800"', b'"\\udc00"', b'"\\ud800\\u0041"'])
+def test_lone_surrogates(data: bytes) -> None:
+    """Test that lone surrogate escapes raise a ValueError, although
+    json.loads accepts them."""
+    json.loads(data)
+    with pytest.raises(ValueError):  # noqa: PT011
+        FrozenDocument.from_json(data)
+    with pytest.raises(ValueError):  # noqa: PT011
+        libjsonpath.DEFAULT_ENV.findall_bytes("$", data)
@@ -1 +1,43 @@
-# TODO:
+import libjsonpath
+from libjsonpath import JSONPathEnvironment
+from libjsonpath.functions import Length
+
+
+def test_standard_functions() -> None:
+    """Test the built-in implementations of the standard functions."""
+    data = [
+        {"tags": ["a", "b"], "name": "foo"},
+        {"tags": [], "name": "bar"},
+        {"name": "baz"},
+    ]
+    assert libjsonpath.findall("$[?length(@.tags) > 0].name", data) == ["foo"]
+    assert libjsonpath.findall("$[?count(@.*) == 2].name", data) == ["foo", "bar"]
+    assert libjsonpath.findall("$[?value(@.name) == 'bar'].name", data) == ["bar"]
+    assert libjsonpath.findall("$[?match(@.name, 'ba.')].name", data) == [
+        "bar",
+        "baz",
+    ]
+    assert libjsonpath.findall("$[?search(@.name, 'o')].name", data) == ["foo"]
+
+
+def test_invalid_regex_does_not_match() -> None:
+    """Test that invalid patterns and non-string arguments never match."""
+    data = [{"a": "x"}, {"a": 1}]
+    assert libjsonpath.findall("$[?match(@.a, '(')]", data) == []
+    assert libjsonpath.findall("$[?search(@.a, 'x')]", data) == [{"a": "x"}]
+
+
+def test_override_standard_function() -> None:
+    """Test that a Python function can replace a standard function."""
+
+    class CodeUnits(Length):
+        def __call__(self, obj: object) -> object:
+            if isinstance(obj, str):
+                return len(obj.encode("utf-16-le")) // 2
+            return super().__call__(obj)
+
+    env = JSONPathEnvironment()
+    env.register_function("length", CodeUnits())
+    data = [{"s": "\U0001f600"}]
+    assert env.findall("$[?length(@.s) == 2]", data) == data
+    assert libjsonpath.findall("$[?length(@.s) == 1]", data) == data
@@ -0,0 +1,68 @@
+from typing import List
+
+import libjsonpath
+from libjsonpath import ExpressionType
+from libjsonpath import FilterFunction
+from libjsonpath import JSONPathEnvironment
+
+
+class Spy(FilterFunction):
+    arg_types = (ExpressionType.value,)
+    return_type = ExpressionType.logical
+
+    def __init__(self) -> None:
+        self.calls: List[object] = []
+
+    def __call__(self, obj: object) -> bool:
+        self.calls.append(obj)
+        return True
+
+
+def test_and_short_circuits() -> None:
+    """Test that the right operand of && is skipped if the left is false."""
+    env = JSONPathEnvironment()
+    spy = Spy()
+    env.register_function("spy", spy)
+    assert env.findall("$[?@.a == 1 && spy(@.a)]", [{"a": 1}, {"a": 2}]) == [
+        {"a": 1}
+    ]
+    assert spy.calls == [1]
+
+
+def test_or_short_circuits() -> None:
+    """Test that the right operand of || is skipped if the left is true."""
+    env = JSONPathEnvironment()
+    spy = Spy()
+    env.register_function("spy", spy)
+    data = [{"a": 1}, {"a": 2}]
+    assert env.findall("$[?@.a == 1 || spy(@.a)]", data) == data
+    assert spy.calls == [2]
+
+
+def test_existence_tests_in_logical_expressions() -> None:
+    """Test that queries are existence tests in logical expressions."""
+    data = [{"a": False, "b": 1}, {"b": 1}]
+    assert libjsonpath.findall("$[?@.a && @.b]", data) == [{"a": False, "b": 1}]
+
+
+def test_reorder_logical_operands() -> None:
+    """Test that cheaper operands are moved to the left."""
+
+    class ReorderingEnvironment(JSONPathEnvironment):
+        reorder_logical_operands = True
+
+    env = ReorderingEnvironment()
+    path = env.compile("$[?count(@..x) > 1 && @.a == 1]")
+    expression = path.segments[0].selectors[0].expression
+    assert isinstance(expression.left, libjsonpath.InfixExpression)
+    assert isinstance(expression.left.left, libjsonpath.RelativeQuery)
+    assert isinstance(expression.right.left, libjsonpath.FunctionCall)
+    data = [{"a": 1, "b": {"x": 1, "y": {"x": 2}}}, {"a": 2}]
+    assert path.findall(data) == [data[0]]
+
+
+def test_operands_are_not_reordered_by_default() -> None:
+    """Test that reordering is opt in."""
+    path = libjsonpath.compile("$[?count(@..x) > 1 && @.a == 1]")
+    expression = path.segments[0].selectors[0].expression
+    assert isinstance(expression.left.left, libjsonpath.FunctionCall)
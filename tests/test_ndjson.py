@@ -0,0 +1,62 @@
+import json
+from pathlib import Path
+
+import pytest
+
+import libjsonpath
+
+RECORDS = [
+    {"id": i, "status": "failed" if i % 3 == 0 else "ok", "tags": ["x"] * (i % 4)}
+    for i in range(200)
+]
+
+DATA = "\n".join(json.dumps(record) for record in RECORDS).encode() + b"\n\n"
+
+
+def test_query_ndjson_in_order() -> None:
+    """Test that matches are returned in line order."""
+    path = libjsonpath.compile("$.tags[1]")
+    rv = list(path.query_ndjson(DATA, threads=4, chunk_size=64))
+    assert rv == [
+        (line, ["x"])
+        for line, record in enumerate(RECORDS)
+        if len(record["tags"]) > 1
+    ]
+
+
+def test_query_ndjson_unordered() -> None:
+    """Test that unordered results contain every match."""
+    path = libjsonpath.compile("$[?@ == 'failed']")
+    rv = list(path.query_ndjson(DATA, threads=4, chunk_size=64, ordered=False))
+    assert sorted(rv) == [
+        (line, ["failed"])
+        for line, record in enumerate(RECORDS)
+        if record["status"] == "failed"
+    ]
+
+
+def test_query_ndjson_as_json() -> None:
+    """Test that matches can be returned as JSON bytes."""
+    path = libjsonpath.compile("$[?@ == 7]")
+    rv = list(path.query_ndjson(DATA, as_json=True))
+    assert rv == [(7, [b"7"])]
+
+
+def test_query_ndjson_file(tmp_path: Path) -> None:
+    """Test that a file can be queried."""
+    file = tmp_path / "data.ndjson"
+    file.write_bytes(DATA)
+    env = libjsonpath.JSONPathEnvironment()
+    rv = list(env.query_ndjson("$.id", file, threads=2, chunk_size=100))
+    assert rv == [(line, [line]) for line in range(len(RECORDS))]
+
+    empty = tmp_path / "empty.ndjson"
+    empty.write_bytes(b"")
+    assert list(env.query_ndjson("$.id", empty)) == []
+
+
+def test_query_ndjson_invalid_line() -> None:
+    """Test that an invalid line is reported with its line number."""
+    path = libjsonpath.compile("$.id")
+    with pytest.raises(ValueError, match="line 1"):
+        list(path.query_ndjson(b'{"id": 1}\n{"id": \n{"id": 3}\n'))
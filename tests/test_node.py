@@ -0,0 +1,25 @@
+import libjsonpath
+
+
+def test_node_location() -> None:
+    """Test that nodes know their location in a document."""
+    data = {"a": [{"b": 1}, {"b": 2}]}
+    nodes = libjsonpath.query("$.a[1].b", data)
+    assert len(nodes) == 1
+    assert nodes[0].value == 2  # noqa: PLR2004
+    assert nodes[0].location == ["a", 1, "b"]
+    assert nodes[0].path() == "$['a'][1]['b']"
+
+
+def test_descendant_node_locations() -> None:
+    """Test that descendant nodes share location prefixes correctly."""
+    data = {"a": {"b": [1, 2]}}
+    paths = [node.path() for node in libjsonpath.query("$..*", data)]
+    assert paths == ["$['a']", "$['a']['b']", "$['a']['b'][0]", "$['a']['b'][1]"]
+
+
+def test_root_node_location() -> None:
+    """Test that the root node has an empty location."""
+    nodes = libjsonpath.query("$", {"a": 1})
+    assert nodes[0].location == []
+    assert nodes[0].path() == "$"
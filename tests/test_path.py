@@ -0,0 +1,249 @@
+from typing import List
+
+import libjsonpath
+from libjsonpath import JSONPathEnvironment
+
+
+class Spy(libjsonpath.FilterFunction):
+    """A filter function that records its arguments in _calls_ and always
+    returns True."""
+
+    arg_types = (libjsonpath.ExpressionType.value,)
+    return_type = libjsonpath.ExpressionType.logical
+
+    def __init__(self, calls: List[object]) -> None:
+        self.calls = calls
+
+    def __call__(self, obj: object) -> bool:
+        self.calls.append(obj)
+        return True
+
+
+def test_compiled_path() -> None:
+    """Test that we can compile a path and use it to query data."""
+    path = libjsonpath.compile("$.a[?@ > 1]")
+    assert path.findall({"a": [1, 2, 3]}) == [2, 3]
+    assert len(path.segments) == 2  # noqa: PLR2004
+
+
+def test_compiled_path_is_bound_to_its_environment() -> None:
+    """Test that a compiled path keeps the functions it was compiled with."""
+    env = JSONPathEnvironment()
+    path = env.compile("$[?count(@.*) == 2]")
+    env.register_function("count", libjsonpath.functions.Length())
+    assert path.findall([[1, 2], [1]]) == [[1, 2]]
+
+
+def test_root_query_in_nested_filter() -> None:
+    """Test that `$` refers to the document root inside nested filters."""
+    data = {"x": 1, "a": [[1, 2], [3]]}
+    assert libjsonpath.findall("$.a[?@[?@ == $.x]]", data) == [[1, 2]]
+
+
+def test_findall_values() -> None:
+    """Test that findall returns values in document order."""
+    data = {"a": [{"b": 1}, {"b": 2}], "b": 3}
+    assert libjsonpath.findall("$", data) == [data]
+    assert libjsonpath.findall("$.a[*].b", data) == [1, 2]
+    assert libjsonpath.compile("$..b").findall(data) == [3, 1, 2]
+
+
+def test_root_queries_are_evaluated_once() -> None:
+    """Test that root queries in filters are resolved once per query."""
+    calls: List[object] = []
+    env = JSONPathEnvironment()
+    env.register_function("spy", Spy(calls))
+    data = {"limits": [5], "items": [{"price": 1}, {"price": 6}, {"price": 3}]}
+    path = env.compile("$.items[?@.price < value($.limits[?spy(@)])]")
+    assert path.findall(data) == [{"price": 1}, {"price": 3}]
+    assert calls == [5]
+    path.findall(data)
+    assert calls == [5, 5]
+
+
+def test_existence_test_stops_at_first_node() -> None:
+    """Test that existence tests don't select more nodes than they need."""
+    calls: List[object] = []
+    env = JSONPathEnvironment()
+    env.register_function("spy", Spy(calls))
+    data = [[1, 2, 3], [], [4, 5]]
+    assert env.findall("$[?@[?spy(@)]]", data) == [[1, 2, 3], [4, 5]]
+    assert calls == [1, 4]
+
+
+def test_exists_first_and_count() -> None:
+    """Test that we can ask for a match count or the first match."""
+    data = {"a": [{"b": 1}, {"b": 2}, {"c": {"b": 3}}]}
+    assert libjsonpath.exists("$..b", data) is True
+    assert libjsonpath.exists("$.x", data) is False
+    assert libjsonpath.count("$..b", data) == 3  # noqa: PLR2004
+    assert libjsonpath.count("$.x", data) == 0
+
+    node = libjsonpath.first("$..b", data)
+    assert node is not None
+    assert node.value == 1
+    assert node.path() == "$['a'][0]['b']"
+    assert libjsonpath.first("$.x", data) is None
+
+    nodes = libjsonpath.query("$..b", data, limit=2)
+    assert [node.value for node in nodes] == [1, 2]
+    assert libjsonpath.query("$", data, limit=0) == []
+
+
+def test_limit_stops_evaluation() -> None:
+    """Test that evaluation stops once a limit has been reached."""
+    calls: List[object] = []
+    env = JSONPathEnvironment()
+    env.register_function("spy", Spy(calls))
+    path = env.compile("$[*][?spy(@)]")
+    data = [[1, 2], [3, 4]]
+    assert path.first(data).value == 1  # type: ignore
+    assert calls == [1]
+    assert path.exists(data) is True
+    assert calls == [1, 1]
+    assert [node.value for node in path.query(data, limit=3)] == [1, 2, 3]
+    assert calls == [1, 1, 1, 2, 3]
+
+
+def test_iter_matches_query() -> None:
+    """Test that lazy iteration yields the same nodes, in the same order."""
+    data = {"a": [{"b": 1}, {"b": [2, {"b": 3}]}], "b": {"c": 4}}
+    env = JSONPathEnvironment()
+    for query in ("$..b", "$..*", "$.a[*].b", "$..[?@.b]", "$.x", "$"):
+        expect = [(node.path(), node.value) for node in env.query(query, data)]
+        got = [(node.path(), node.value) for node in env.iter(query, data)]
+        assert got == expect, query
+
+    it = env.compile("$.a[*].b").iter(data)
+    assert next(it).value == 1
+    assert next(it).value == [2, {"b": 3}]
+
+
+def test_query_set() -> None:
+    """Test that a query set gives the same results as separate queries."""
+    data = {
+        "users": [{"name": "a", "id": 1}, {"name": "b", "id": 2}],
+        "meta": {"name": "c", "tags": [{"name": "d"}]},
+    }
+    paths = [
+        "$.users[*].name",
+        "$.users[*].id",
+        "$..name",
+        "$..id",
+        "$..name",
+        "$.users[?@.id > 1].name",
+        "$",
+        "$.missing",
+    ]
+    env = JSONPathEnvironment()
+    query_set = env.query_set(paths)
+    assert len(query_set) == len(paths)
+    assert query_set.findall(data) == [env.findall(path, data) for path in paths]
+    assert [[node.path() for node in nodes] for nodes in query_set.query(data)] == [
+        [node.path() for node in env.query(path, data)] for path in paths
+    ]
+
+
+def test_query_many_documents() -> None:
+    """Test that a compiled path can be applied to an iterable of documents."""
+    docs = [{"a": [1, 2], "b": 1}, {"a": []}, {"a": [3], "b": 3}]
+    path = libjsonpath.compile("$.a[?@ == $.b]")
+    assert path.findall_many(iter(docs)) == [[1], [], [3]]
+    assert [
+        [node.path() for node in nodes] for nodes in path.query_many(docs)
+    ] == [["$['a'][0]"], [], ["$['a'][0]"]]
+    assert JSONPathEnvironment().findall_many("$.b", docs) == [[1], [], [3]]
+
+
+def test_name_selectors() -> None:
+    """Test that names are looked up as string keys only."""
+    data = {1: "int", "1": "str", "é": [{"é": True}], "b": {"é": 1}}
+    path = libjsonpath.compile("$['1', 'é', 'x']")
+    assert path.findall(data) == ["str", [{"é": True}]]
+    assert [node.path() for node in path.query(data)] == ["$['1']", "$['é']"]
+    assert libjsonpath.findall("$.é[?@.é].é", data) == [True]
+    assert libjsonpath.findall("$.*.é", data) == [1]
+
+
+def test_slice_selectors() -> None:
+    """Test that slices select the same items as Python slices."""
+    data = list(range(7))
+    frozen = libjsonpath.FrozenDocument(data)
+    bounds = ["", "0", "2", "-2", "6", "-8", "10", "9007199254740991"]
+    steps = ["", "1", "2", "-1", "-3", "9007199254740991", "-9007199254740991"]
+    for start in bounds:
+        for stop in bounds:
+            for step in steps:
+                query = f"$[{start}:{stop}:{step}]"
+                want = data[
+                    slice(
+                        int(start) if start else None,
+                        int(stop) if stop else None,
+                        int(step) if step else None,
+                    )
+                ]
+                assert libjsonpath.findall(query, data) == want, query
+                assert libjsonpath.findall(query, frozen) == want, query
+    assert libjsonpath.findall("$[::0]", data) == []
+    assert [node.path() for node in libjsonpath.query("$[5:1:-2]", data)] == [
+        "$[5]",
+        "$[3]",
+    ]
+
+
+def test_recursive_descent_into_deeply_nested_data() -> None:
+    """Test that descendants are visited in document order, at any depth."""
+    data: object = {"a": 0}
+    for i in range(1, 100000):
+        data = [{"a": i}, data] if i % 2 else {"a": i, "b": data}
+    assert libjsonpath.findall("$..a", data)[:4] == [99999, 99998, 99997, 99996]
+    assert libjsonpath.compile("$..a").count(data) == 100000
+
+    nodes = libjsonpath.query("$..a", data)
+    assert len(nodes) == 100000
+    assert nodes[-1].path() == "$" + "[1]['b']" * 49999 + "[1]['a']"
+    del nodes
+
+    doc = libjsonpath.FrozenDocument(data)
+    assert libjsonpath.findall("$..a", doc)[:4] == [99999, 99998, 99997, 99996]
+    assert libjsonpath.query("$..a", doc)[-1].path() == (
+        "$" + "[1]['b']" * 49999 + "[1]['a']"
+    )
+    assert libjsonpath.findall("$..a", doc.to_python())[-1] == 0
+
+    doc = libjsonpath.FrozenDocument([data, data, [data]])
+    assert len(libjsonpath.findall("$[?@ == $[0]]", doc)) == 2  # noqa: PLR2004
+
+    data = {"a": [{"x": 1}, {"x": 2, "y": {"x": 3}}], "b": {"x": 4}}
+    assert libjsonpath.findall("$..x", data) == [1, 2, 3, 4]
+    assert [node.path() for node in libjsonpath.query("$..[?@.x > 1]", data)] == [
+        "$['b']",
+        "$['a'][1]",
+        "$['a'][1]['y']",
+    ]
+
+
+def test_filter_and_wildcard_selectors_in_one_segment() -> None:
+    """Test that nodes are selected in selector order, then document order."""
+    data = {"a": [{"x": 1}, {"y": 2}, {"x": 3, "y": 4}, 5]}
+    query = "$.a[?@.y, 0, ?@.x, *]"
+    assert libjsonpath.findall(query, data) == [
+        {"y": 2},
+        {"x": 3, "y": 4},
+        {"x": 1},
+        {"x": 1},
+        {"x": 3, "y": 4},
+        {"x": 1},
+        {"y": 2},
+        {"x": 3, "y": 4},
+        5,
+    ]
+    assert [node.path() for node in libjsonpath.query(query, data)][-4:] == [
+        "$['a'][0]",
+        "$['a'][1]",
+        "$['a'][2]",
+        "$['a'][3]",
+    ]
+    assert libjsonpath.query(query, data, limit=3)[2].path() == "$['a'][0]"
+    assert libjsonpath.findall("$.a[*, ?@.x].x", data) == [1, 3, 1, 3]
+    assert libjsonpath.findall("$[*, ?@ > 1]", {"p": 1, "q": 2}) == [1, 2, 2]
@@ -0,0 +1,38 @@
+import libjsonpath
+from libjsonpath import JSONPathEnvironment
+
+
+def test_dot_does_not_match_line_terminators() -> None:
+    """Test that `.` matches neither a line feed nor a carriage return."""
+    data = [{"a": "a\nb"}, {"a": "a\rb"}, {"a": "axb"}]
+    assert libjsonpath.findall("$[?match(@.a, 'a.b')].a", data) == ["axb"]
+    assert libjsonpath.findall("$[?match(@.a, 'a[.]b')].a", data) == []
+
+
+def test_caret_and_dollar_are_literals() -> None:
+    """Test that I-Regexp patterns don't have anchors."""
+    data = [{"a": "^ab$"}, {"a": "ab"}]
+    assert libjsonpath.findall("$[?match(@.a, '^ab$')].a", data) == ["^ab$"]
+    assert libjsonpath.findall("$[?search(@.a, 'b$')].a", data) == ["^ab$"]
+    assert libjsonpath.findall("$[?match(@.a, '[^a]ab[$]')].a", data) == ["^ab$"]
+
+
+def test_literal_patterns_are_not_cached() -> None:
+    """Test that string literal patterns are compiled with the query."""
+    env = JSONPathEnvironment()
+    env.findall("$[?match(@, 'a.*')]", ["ab", "cd", "ae"])
+    assert env.regex_cache_info().size == 0
+
+
+def test_dynamic_patterns_are_cached() -> None:
+    """Test that patterns taken from the data are compiled once."""
+    env = JSONPathEnvironment()
+    data = {"pattern": "a.*", "items": ["ab", "cd", "ae"]}
+    assert env.findall("$.items[?match(@, $.pattern)]", data) == ["ab", "ae"]
+    info = env.regex_cache_info()
+    assert info.misses == 1
+    assert info.hits == 2  # noqa: PLR2004
+    assert info.size == 1
+
+    env.regex_cache_clear()
+    assert env.regex_cache_info().size == 0
@@ -1,3 +1,5 @@
+import pytest
+
 import libjsonpath
 
 
@@ -13,3 +15,54 @@ def test_non_singular_query() -> None:
     query = "$.*"
     segments = libjsonpath.parse(query)
     assert not libjsonpath.singular_query(segments)
+
+
+DATA = {
+    "a": {"b": [{"c": 1}, {"c": 2}, "x"]},
+    "d": [[1, 2], {"e": None}],
+}
+
+
+@pytest.mark.parametrize(
+    "query",
+    [
+        "$",
+        "$.a.b[0].c",
+        "$.a.b[-1]",
+        "$.a.b[-4]",
+        "$.a.b[3]",
+        "$.a.b[2].c",
+        "$.d[1].e",
+        "$.d[0][1]",
+        "$.d.e",
+        "$.nosuchthing.b",
+    ],
+)
+def test_singular_query_lookup(query: str) -> None:
+    """Test that singular queries select the same nodes as other queries."""
+    env = libjsonpath.JSONPathEnvironment()
+    path = env.compile(query)
+    want = env.from_segments(libjsonpath.parse(query), DATA)
+    assert [(node.path(), node.value) for node in path.query(DATA)] == [
+        (node.path(), node.value) for node in want
+    ]
+    assert path.findall(DATA) == [node.value for node in want]
+    assert path.exists(DATA) == bool(want)
+    assert path.count(DATA) == len(want)
+
+
+@pytest.mark.parametrize(
+    ("query", "want"),
+    [
+        ("$.a.b[?@.c == 2]", [{"c": 2}]),
+        ("$.a.b[?@.c]", [{"c": 1}, {"c": 2}]),
+        ("$.a.b[?!@.c]", ["x"]),
+        ("$.a.b[?@.c == @.nosuchthing]", ["x"]),
+        ("$.a.b[?@.c < $.d[0][1]]", [{"c": 1}]),
+        ("$.d[?length(@[0]) == 2]", []),
+        ("$.d[?@.e == null]", [{"e": None}]),
+    ],
+)
+def test_singular_queries_in_filters(query: str, want: object) -> None:
+    """Test singular queries used as filter operands."""
+    assert libjsonpath.findall(query, DATA) == want
@@ -0,0 +1,92 @@
+import io
+import json
+from pathlib import Path
+
+import pytest
+
+import libjsonpath
+
+DATA = {
+    "meta": {"count": 5, "ké\ny": ["a", "b"]},
+    "records": [
+        {"id": 1, "status": "ok", "tags": {"id": "x"}},
+        {"id": 2, "status": "failed", "tags": {}},
+        {"id": 3, "status": "failed", "tags": {"id": "y"}},
+        {"id": 4, "status": "ok", "tags": []},
+        {"id": 5, "status": "failed", "tags": [{"id": "z"}]},
+    ],
+}
+
+QUERIES = [
+    "$",
+    "$.meta",
+    "$.meta['ké\\ny'][1]",
+    "$.records[?@.status == 'failed'].id",
+    "$.records[?count(@.tags.*) > 0]",
+    "$.records[1:4].id",
+    "$.records[::2].id",
+    "$.records[-1].id",
+    "$.records[0, 1].id",
+    "$.records[?@.id >= $.meta.count].id",
+    "$..tags..id",
+    "$..records[?match(@.status, 'f.*')].id",
+    "$.nosuchthing",
+]
+
+
+@pytest.mark.parametrize("query", QUERIES)
+def test_stream_matches_query(query: str) -> None:
+    """Test that streaming a query gives the same nodes as query()."""
+    data = json.dumps(DATA).encode()
+    path = libjsonpath.compile(query)
+    streamed = [
+        (node.path(), node.value)
+        for node in path.stream(io.BytesIO(data), chunk_size=7)
+    ]
+    assert streamed == [(node.path(), node.value) for node in path.query(DATA)]
+
+
+def test_stream_from_file(tmp_path: Path) -> None:
+    """Test that a file name can be streamed."""
+    file = tmp_path / "data.json"
+    file.write_text(json.dumps(DATA))
+    env = libjsonpath.JSONPathEnvironment()
+    nodes = env.stream("$.records[*].id", file)
+    assert [node.value for node in nodes] == [1, 2, 3, 4, 5]
+
+
+def test_stream_is_lazy() -> None:
+    """Test that matches are yielded before the whole document is read."""
+    data = b'[{"id": 1}, {"id": 2}, ' + b"!" * 1000
+    it = libjsonpath.compile("$[*].id").stream(io.BytesIO(data), chunk_size=16)
+    assert next(it).value == 1
+    assert next(it).value == 2
+    with pytest.raises(ValueError):  # noqa: PT011
+        next(it)
+
+
+def test_stream_descendants_in_document_order() -> None:
+    """Test that descendants are streamed in document order, which can
+    differ from the order query() returns them in."""
+    path = libjsonpath.compile("$..[1]")
+    streamed = path.stream(io.BytesIO(b"[[7, 8], 9]"))
+    assert [(node.path(), node.value) for node in streamed] == [
+        ("$[0][1]", 8),
+        ("$[1]", 9),
+    ]
+    assert path.findall([[7, 8], 9]) == [9, 8]
+
+
+def test_stream_duplicate_keys() -> None:
+    """Test that each member with a duplicate key is streamed."""
+    data = b'{"a": 1, "b": {"a": 2, "a": 3}, "a": 4}'
+    path = libjsonpath.compile("$.a")
+    assert [node.value for node in path.stream(io.BytesIO(data))] == [1, 4]
+    path = libjsonpath.compile("$.b")
+    assert [node.value for node in path.stream(io.BytesIO(data))] == [{"a": 3}]
+
+
+def test_stream_text_file() -> None:
+    """Test that streaming from a text file is an error."""
+    with pytest.raises(TypeError):
+        list(libjsonpath.compile("$").stream(io.StringIO("[]")))